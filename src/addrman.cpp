@@ -6,9 +6,47 @@
 
 #include <addrman.h>
 
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <serialize.h>
 
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const noexcept
+{
+    unsigned char ip[16];
+    for (int n = 0; n < 16; n++) {
+        ip[15 - n] = addr.GetByte(n);
+    }
+    return CSipHasher(k0, k1).Write(ip, sizeof(ip)).Finalize();
+}
+
+void CAddrTablePositions::Insert(int pos)
+{
+    assert(m_index[pos] == -1);
+    m_index[pos] = m_positions.size();
+    m_positions.push_back(pos);
+}
+
+void CAddrTablePositions::Erase(int pos)
+{
+    const int index = m_index[pos];
+    assert(index != -1);
+    const int last = m_positions.back();
+    m_positions[index] = last;
+    m_index[last] = index;
+    m_positions.pop_back();
+    m_index[pos] = -1;
+}
+
+void CAddrTablePositions::Clear()
+{
+    for (int pos : m_positions) {
+        m_index[pos] = -1;
+    }
+    m_positions.clear();
+}
+
 int CAddrInfo::GetTriedBucket(const uint256& nKey) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetCheapHash();
@@ -67,12 +105,12 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    auto it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return nullptr;
@@ -124,6 +162,24 @@ void CAddrMan::Delete(int nId)
     nNew--;
 }
 
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    int& entry = vvNew[nUBucket][nUBucketPos];
+    const int pos = nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos;
+    if (entry == -1 && nId != -1) m_new_positions.Insert(pos);
+    if (entry != -1 && nId == -1) m_new_positions.Erase(pos);
+    entry = nId;
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    int& entry = vvTried[nKBucket][nKBucketPos];
+    const int pos = nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos;
+    if (entry == -1 && nId != -1) m_tried_positions.Insert(pos);
+    if (entry != -1 && nId == -1) m_tried_positions.Erase(pos);
+    entry = nId;
+}
+
 void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
 {
     // if there is an entry in the specified bucket, delete it.
@@ -132,7 +188,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -145,7 +201,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -166,7 +222,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -177,12 +233,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -316,7 +372,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -362,13 +418,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = insecure_rand.randrange(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
+            int nKPos = m_tried_positions.Random(insecure_rand);
+            int nId = vvTried[nKPos / ADDRMAN_BUCKET_SIZE][nKPos % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -379,13 +430,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
+            int nUPos = m_new_positions.Random(insecure_rand);
+            int nId = vvNew[nUPos / ADDRMAN_BUCKET_SIZE][nUPos % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -435,9 +481,13 @@ int CAddrMan::Check_()
     if (mapNew.size() != (size_t)nNew)
         return -10;
 
+    size_t nTriedPositions = 0;
+    size_t nNewPositions = 0;
+
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
              if (vvTried[n][i] != -1) {
+                 nTriedPositions++;
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
                  if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
@@ -452,6 +502,7 @@ int CAddrMan::Check_()
     for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
             if (vvNew[n][i] != -1) {
+                nNewPositions++;
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
                 if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
@@ -468,6 +519,10 @@ int CAddrMan::Check_()
         return -15;
     if (nKey.IsNull())
         return -16;
+    if (m_tried_positions.size() != nTriedPositions)
+        return -20;
+    if (m_new_positions.size() != nNewPositions)
+        return -21;
 
     return 0;
 }
@@ -7,6 +7,7 @@
 #ifndef BITCOIN_ADDRMAN_H
 #define BITCOIN_ADDRMAN_H
 
+#include <flatmap.h>
 #include <netaddress.h>
 #include <protocol.h>
 #include <random.h>
@@ -17,6 +18,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -170,6 +172,44 @@ public:
 //! the maximum time we'll spend trying to resolve a tried table collision, in seconds
 static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
 
+/** Salted hasher for the address index, so that peers cannot make addresses collide in it. */
+class SaltedNetAddrHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const noexcept;
+};
+
+/** Occupied positions of a bucket table, to pick one at random in constant time. */
+class CAddrTablePositions
+{
+private:
+    //! the occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position in bucket)
+    std::vector<int> m_positions;
+
+    //! index of each position of the table in m_positions, or -1 if empty
+    std::vector<int> m_index;
+
+public:
+    explicit CAddrTablePositions(size_t table_size) : m_index(table_size, -1) {}
+
+    void Insert(int pos);
+    void Erase(int pos);
+    void Clear();
+
+    size_t size() const { return m_positions.size(); }
+
+    //! Return one of the occupied positions, uniformly at random. There must be one.
+    int Random(FastRandomContext& rng) const
+    {
+        return m_positions[rng.randrange(m_positions.size())];
+    }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -184,10 +224,10 @@ private:
     int nIdCount GUARDED_BY(cs);
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    flatmap<int, CAddrInfo> mapInfo GUARDED_BY(cs);
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    flatmap<CNetAddr, int, SaltedNetAddrHasher> mapAddr GUARDED_BY(cs);
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
@@ -204,6 +244,10 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
 
+    //! occupied positions of vvTried and vvNew, for Select
+    CAddrTablePositions m_tried_positions GUARDED_BY(cs){ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE};
+    CAddrTablePositions m_new_positions GUARDED_BY(cs){ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE};
+
     //! last time Good was called (memory only)
     int64_t nLastGood GUARDED_BY(cs);
 
@@ -233,6 +277,12 @@ protected:
     //! Delete an entry. It must not be in tried, and have refcount 0.
     void Delete(int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Set a position in the "new" table to nId, or -1 to empty it.
+    void SetNew(int nUBucket, int nUBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Set a position in the "tried" table to nId, or -1 to empty it.
+    void SetTried(int nKBucket, int nKBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -312,7 +362,8 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.reserve(mapInfo.size());
         int nIds = 0;
         for (const auto& entry : mapInfo) {
             mapUnkIds[entry.first] = nIds;
@@ -390,7 +441,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -410,7 +461,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -430,7 +481,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -438,9 +489,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (auto it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                auto itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -469,6 +520,8 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        m_new_positions.Clear();
+        m_tried_positions.Clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -0,0 +1,130 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrman.h>
+#include <bench/bench.h>
+#include <clientversion.h>
+#include <random.h>
+#include <streams.h>
+#include <util/time.h>
+
+#include <vector>
+
+/* Addresses as a node collects them: many sources, each relaying addresses
+ * from all over the address space. */
+static const size_t NUM_SOURCES = 64;
+static const size_t NUM_ADDRESSES_PER_SOURCE = 256;
+
+static std::vector<CAddress> g_sources;
+static std::vector<std::vector<CAddress>> g_addresses;
+
+static CAddress RandomIPv4Address(FastRandomContext& rng)
+{
+    struct in_addr addr;
+    addr.s_addr = rng.rand32();
+    CAddress ret(CService(addr, 8333), NODE_NETWORK);
+    ret.nTime = GetAdjustedTime();
+    return ret;
+}
+
+static void CreateAddresses()
+{
+    if (!g_sources.empty()) return;
+
+    FastRandomContext rng(uint256(std::vector<unsigned char>(32, 123)));
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        g_sources.push_back(RandomIPv4Address(rng));
+        g_addresses.emplace_back();
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
+            g_addresses[source_i].push_back(RandomIPv4Address(rng));
+        }
+    }
+}
+
+static void AddAddressesToAddrMan(CAddrMan& addrman)
+{
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        addrman.Add(g_addresses[source_i], g_sources[source_i]);
+    }
+}
+
+static void FillAddrMan(CAddrMan& addrman)
+{
+    CreateAddresses();
+    AddAddressesToAddrMan(addrman);
+    // Connect to some of them, moving those to the tried table.
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; addr_i += 8) {
+            addrman.Good(g_addresses[source_i][addr_i]);
+        }
+    }
+}
+
+static void AddrManAdd(benchmark::State& state)
+{
+    CreateAddresses();
+
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        AddAddressesToAddrMan(addrman);
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        const CAddress& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManSelectSparse(benchmark::State& state)
+{
+    // A handful of addresses in tables with tens of thousands of positions, as
+    // right after startup without peers.dat.
+    CAddrMan addrman;
+    CreateAddresses();
+    addrman.Add(g_addresses[0][0], g_sources[0]);
+    addrman.Add(g_addresses[1][0], g_sources[1]);
+    addrman.Good(g_addresses[1][0]);
+
+    while (state.KeepRunning()) {
+        const CAddress& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        const auto& addresses = addrman.GetAddr();
+        assert(addresses.size() > 0);
+    }
+}
+
+static void AddrManSerialize(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << addrman;
+        CAddrMan addrman2;
+        stream >> addrman2;
+        assert(addrman2.size() == addrman.size());
+    }
+}
+
+BENCHMARK(AddrManAdd, 5);
+BENCHMARK(AddrManSelect, 1000000);
+BENCHMARK(AddrManSelectSparse, 1000000);
+BENCHMARK(AddrManGetAddr, 500);
+BENCHMARK(AddrManSerialize, 20);
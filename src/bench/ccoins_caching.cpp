@@ -6,8 +6,10 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -87,3 +89,44 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Fill a coins map with 10000 P2PKH coins, look all of them up and erase them
+// again the way a flush does, to compare CCoinsMap with the std::unordered_map
+// it replaced.
+template <typename Map>
+static void CoinsMapFillAndFlush(benchmark::State& state)
+{
+    FastRandomContext ctx(true);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10000; i++) {
+        outpoints.emplace_back(ctx.rand256(), ctx.randrange(4));
+    }
+    Coin coin;
+    coin.out.nValue = COIN;
+    coin.out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    coin.nHeight = 1;
+
+    while (state.KeepRunning()) {
+        Map map;
+        for (const COutPoint& outpoint : outpoints) {
+            map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(Coin(coin)));
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            assert(map.find(outpoint) != map.end());
+        }
+        for (auto it = map.begin(); it != map.end(); it = map.erase(it)) {}
+    }
+}
+
+static void CCoinsMapFlat(benchmark::State& state)
+{
+    CoinsMapFillAndFlush<CCoinsMap>(state);
+}
+
+static void CCoinsMapUnordered(benchmark::State& state)
+{
+    CoinsMapFillAndFlush<std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>>(state);
+}
+
+BENCHMARK(CCoinsMapFlat, 100);
+BENCHMARK(CCoinsMapUnordered, 100);
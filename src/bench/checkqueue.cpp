@@ -21,7 +21,7 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+static void CheckQueuePrevectorJobs(benchmark::State& state, int threads)
 {
     struct PrevectorJob {
         prevector<PREVECTOR_SIZE, uint8_t> p;
@@ -38,7 +38,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < threads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -59,4 +59,24 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CheckQueuePrevectorJobs(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+// Scaling with the number of script verification threads (-par)
+static void CCheckQueueSpeedPrevectorJob_2Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 2); }
+static void CCheckQueueSpeedPrevectorJob_4Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 4); }
+static void CCheckQueueSpeedPrevectorJob_8Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 8); }
+static void CCheckQueueSpeedPrevectorJob_16Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 16); }
+static void CCheckQueueSpeedPrevectorJob_32Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 32); }
+static void CCheckQueueSpeedPrevectorJob_64Threads(benchmark::State& state) { CheckQueuePrevectorJobs(state, 64); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_2Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_4Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_8Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_16Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_32Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_64Threads, 1400);
@@ -77,6 +77,36 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+/* Number of values to hash per iteration of the SipHash throughput benchmarks */
+static const size_t SIPHASH_BATCH_SIZE = 1024;
+
+static void SipHash_32b_Loop(benchmark::State& state)
+{
+    std::vector<uint256> vals(SIPHASH_BATCH_SIZE);
+    std::vector<uint64_t> out(SIPHASH_BATCH_SIZE);
+    for (size_t i = 0; i < vals.size(); ++i) *((uint64_t*)vals[i].begin()) = i;
+    uint64_t k1 = 0;
+    while (state.KeepRunning()) {
+        ++k1;
+        for (size_t i = 0; i < vals.size(); ++i) out[i] = SipHashUint256(0, k1, vals[i]);
+    }
+}
+
+static void SipHash_32b_Batch(benchmark::State& state)
+{
+    std::vector<uint256> vals(SIPHASH_BATCH_SIZE);
+    std::vector<const uint256*> ptrs(SIPHASH_BATCH_SIZE);
+    std::vector<uint64_t> out(SIPHASH_BATCH_SIZE);
+    for (size_t i = 0; i < vals.size(); ++i) {
+        *((uint64_t*)vals[i].begin()) = i;
+        ptrs[i] = &vals[i];
+    }
+    uint64_t k1 = 0;
+    while (state.KeepRunning()) {
+        SipHashUint256Batch(0, ++k1, ptrs.data(), ptrs.size(), out.data());
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -100,6 +130,8 @@ BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
+BENCHMARK(SipHash_32b_Loop, 40 * 1000);
+BENCHMARK(SipHash_32b_Batch, 40 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
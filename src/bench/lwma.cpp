@@ -0,0 +1,60 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+
+#include <vector>
+
+static constexpr int LWMA_BENCH_CHAIN_LENGTH = 100000;
+
+static std::vector<CBlockIndex> CreateLwmaChain(const Consensus::Params& params)
+{
+    FastRandomContext rng(true);
+    std::vector<CBlockIndex> blocks(LWMA_BENCH_CHAIN_LENGTH);
+    for (int i = 0; i < LWMA_BENCH_CHAIN_LENGTH; i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = i ? blocks[i - 1].nTime + rng.randrange(3 * params.nPowTargetSpacing) : 1269211443;
+        blocks[i].nBits = 0x1c000001 + rng.randrange(0x007fffff);
+        blocks[i].BuildSkip();
+    }
+    return blocks;
+}
+
+/** Retarget every header of the chain by walking the full window each time. */
+static void LwmaUncached(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const std::vector<CBlockIndex> blocks = CreateLwmaChain(params);
+    while (state.KeepRunning()) {
+        for (int i = params.nZawyLwmaAveragingWindow; i < LWMA_BENCH_CHAIN_LENGTH; i++) {
+            LwmaCalculateNextWorkRequiredUncached(&blocks[i], params);
+        }
+    }
+}
+
+/** Retarget every header of the chain, sliding the cached window from the parent. */
+static void LwmaCached(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const std::vector<CBlockIndex> blocks = CreateLwmaChain(params);
+    while (state.KeepRunning()) {
+        for (const CBlockIndex& block : blocks) {
+            block.lwmaWindow.reset();
+        }
+        for (int i = params.nZawyLwmaAveragingWindow; i < LWMA_BENCH_CHAIN_LENGTH; i++) {
+            LwmaCalculateNextWorkRequired(&blocks[i], params);
+        }
+    }
+}
+
+BENCHMARK(LwmaUncached, 2);
+BENCHMARK(LwmaCached, 20);
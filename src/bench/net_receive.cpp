@@ -0,0 +1,72 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <protocol.h>
+
+#include <list>
+#include <vector>
+
+/** A stream of messages like a relaying node receives from a peer, as read from the socket. */
+static std::vector<unsigned char> MessageMix()
+{
+    // Command and payload size of each message, in the order they arrive
+    static const std::vector<std::pair<std::string, size_t>> mix{
+        {NetMsgType::INV, 37}, {NetMsgType::GETDATA, 37}, {NetMsgType::TX, 226},
+        {NetMsgType::INV, 73}, {NetMsgType::TX, 374}, {NetMsgType::PING, 8},
+        {NetMsgType::INV, 37}, {NetMsgType::TX, 225}, {NetMsgType::FEEFILTER, 8},
+        {NetMsgType::INV, 361}, {NetMsgType::TX, 1210}, {NetMsgType::GETDATA, 109},
+        {NetMsgType::TX, 520}, {NetMsgType::ADDR, 31}, {NetMsgType::INV, 37},
+        {NetMsgType::TX, 225}, {NetMsgType::PONG, 8}, {NetMsgType::HEADERS, 82},
+        {NetMsgType::CMPCTBLOCK, 18000}, {NetMsgType::GETBLOCKTXN, 45},
+        {NetMsgType::BLOCKTXN, 9000}, {NetMsgType::INV, 3637}, {NetMsgType::TX, 45000},
+        {NetMsgType::ADDR, 30003}, {NetMsgType::HEADERS, 162003},
+    };
+    std::vector<unsigned char> stream;
+    for (const auto& entry : mix) {
+        CSerializedNetMsg msg;
+        msg.command = entry.first;
+        msg.data.assign(entry.second, 0x55);
+        const CSharedNetMsg wire(std::move(msg));
+        stream.insert(stream.end(), wire.wire.begin(), wire.wire.end());
+    }
+    return stream;
+}
+
+static void ReceiveMessages(benchmark::State& state, bool use_pool)
+{
+    const std::vector<unsigned char> stream = MessageMix();
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(), "", true);
+    CNetMessagePool pool;
+    // The socket handler reads up to 64 KiB at a time
+    const size_t chunk_size = 0x10000;
+
+    while (state.KeepRunning()) {
+        for (size_t pos = 0; pos < stream.size(); pos += chunk_size) {
+            const size_t size = std::min(chunk_size, stream.size() - pos);
+            bool complete;
+            bool ret = node.ReceiveMsgBytes((const char*)stream.data() + pos, size, complete, use_pool ? &pool : nullptr);
+            assert(ret);
+            if (!complete) continue;
+            // Take out the complete messages as if they got processed
+            std::list<CNetMessage> msgs;
+            node.PopCompleteMessages(msgs);
+            if (use_pool) pool.Recycle(msgs);
+        }
+    }
+}
+
+static void ReceiveMsgBytes(benchmark::State& state)
+{
+    ReceiveMessages(state, false);
+}
+
+static void ReceiveMsgBytesPooled(benchmark::State& state)
+{
+    ReceiveMessages(state, true);
+}
+
+BENCHMARK(ReceiveMsgBytes, 1000);
+BENCHMARK(ReceiveMsgBytesPooled, 1000);
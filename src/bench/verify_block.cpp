@@ -0,0 +1,81 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <script/standard.h>
+
+#include <vector>
+
+/** Number of inputs in the block, each with its own signature. */
+static const size_t NUM_INPUTS = 2048;
+
+/**
+ * The signature checks of a block: NUM_INPUTS P2WPKH inputs, spending outputs
+ * of num_keys keys in turn. Wallets reusing addresses make blocks with many
+ * inputs per key. With as many keys as inputs, every key is new to the block,
+ * and there are more of them than a verifying thread keeps parsed.
+ */
+static void VerifyBlockSignatures(benchmark::State& state, size_t num_keys)
+{
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S;
+
+    std::vector<CKey> keys(num_keys);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+
+    CMutableTransaction txCredit;
+    txCredit.nVersion = 1;
+    txCredit.vin.resize(1);
+    txCredit.vin[0].prevout.SetNull();
+    txCredit.vin[0].scriptSig = CScript() << CScriptNum(0) << CScriptNum(0);
+    txCredit.vout.resize(NUM_INPUTS);
+    for (size_t i = 0; i < NUM_INPUTS; i++) {
+        txCredit.vout[i].scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(keys[i % num_keys].GetPubKey().GetID()));
+        txCredit.vout[i].nValue = 1000 + i;
+    }
+
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    txSpend.vin.resize(NUM_INPUTS);
+    txSpend.vout.resize(1);
+    for (size_t i = 0; i < NUM_INPUTS; i++) {
+        txSpend.vin[i].prevout = COutPoint(txCredit.GetHash(), i);
+    }
+    const PrecomputedTransactionData txdata(txSpend);
+    for (size_t i = 0; i < NUM_INPUTS; i++) {
+        const CKey& key = keys[i % num_keys];
+        const CScript scriptCode = GetScriptForDestination(PKHash(key.GetPubKey()));
+        std::vector<unsigned char> sig;
+        key.Sign(SignatureHash(scriptCode, txSpend, i, SIGHASH_ALL, txCredit.vout[i].nValue, SigVersion::WITNESS_V0, false, &txdata), sig);
+        sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        txSpend.vin[i].scriptWitness.stack = {sig, ToByteVector(key.GetPubKey())};
+    }
+    const CTransaction tx(txSpend);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            ScriptError err;
+            bool success = VerifyScript(tx.vin[i].scriptSig, txCredit.vout[i].scriptPubKey, &tx.vin[i].scriptWitness, flags,
+                TransactionSignatureChecker(&tx, i, txCredit.vout[i].nValue, txdata), &err);
+            assert(success);
+        }
+    }
+}
+
+static void VerifyBlockSignaturesDistinctKeys(benchmark::State& state)
+{
+    VerifyBlockSignatures(state, NUM_INPUTS);
+}
+
+static void VerifyBlockSignaturesRepeatedKeys(benchmark::State& state)
+{
+    VerifyBlockSignatures(state, 32);
+}
+
+BENCHMARK(VerifyBlockSignaturesDistinctKeys, 3);
+BENCHMARK(VerifyBlockSignaturesRepeatedKeys, 3);
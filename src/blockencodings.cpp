@@ -17,16 +17,25 @@
 
 #include <unordered_map>
 
+/** Number of bits in the filter of a compact block's short IDs that mempool
+ *  transactions are checked against first. 16 KiB stays in the L1 cache. */
+static constexpr size_t SHORTID_FILTER_BITS = 1 << 17;
+
+/** Number of mempool transactions whose short IDs are computed together. */
+static constexpr size_t SHORTID_BATCH_SIZE = 64;
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
     FillShortTxIDSelector();
     //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
+    std::vector<const uint256*> txhashes(shorttxids.size());
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        txhashes[i - 1] = fUseWTXID ? &tx.GetWitnessHash() : &tx.GetHash();
     }
+    GetShortIDs(txhashes.data(), txhashes.size(), shorttxids.data());
 }
 
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
@@ -45,6 +54,14 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const* txhashes, size_t count, uint64_t* shortids) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, count, shortids);
+    for (size_t i = 0; i < count; i++) {
+        shortids[i] &= 0xffffffffffffL;
+    }
+}
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -106,38 +123,67 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     if (shorttxids.size() != cmpctblock.shorttxids.size())
         return READ_STATUS_FAILED; // Short ID collision
 
+    // Almost all of the mempool is not in the block. Rule those transactions
+    // out with a bitmap of the block's short IDs, which stays in the L1 cache,
+    // before paying for a lookup in the map.
+    std::vector<uint64_t> shortid_filter(SHORTID_FILTER_BITS / 64);
+    for (const uint64_t shortid : cmpctblock.shorttxids) {
+        shortid_filter[(shortid >> 6) & (SHORTID_FILTER_BITS / 64 - 1)] |= uint64_t{1} << (shortid & 63);
+    }
+    const auto maybe_in_block = [&shortid_filter](uint64_t shortid) {
+        return (shortid_filter[(shortid >> 6) & (SHORTID_FILTER_BITS / 64 - 1)] >> (shortid & 63)) & 1;
+    };
+
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
-                mempool_count++;
-            } else {
-                // If we find two mempool txn that match the short id, just request it.
-                // This should be rare enough that the extra bandwidth doesn't matter,
-                // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
-                    mempool_count--;
+    const uint256* batch_hashes[SHORTID_BATCH_SIZE];
+    uint64_t batch_shortids[SHORTID_BATCH_SIZE];
+    for (size_t batch_start = 0; batch_start < vTxHashes.size() && mempool_count != shorttxids.size(); batch_start += SHORTID_BATCH_SIZE) {
+        const size_t batch_size = std::min(SHORTID_BATCH_SIZE, vTxHashes.size() - batch_start);
+        for (size_t j = 0; j < batch_size; j++) {
+            batch_hashes[j] = &vTxHashes[batch_start + j].first;
+        }
+        cmpctblock.GetShortIDs(batch_hashes, batch_size, batch_shortids);
+        for (size_t j = 0; j < batch_size; j++) {
+            const size_t i = batch_start + j;
+            uint64_t shortid = batch_shortids[j];
+            if (!maybe_in_block(shortid)) continue;
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+            if (idit != shorttxids.end()) {
+                if (!have_txn[idit->second]) {
+                    txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
+                    have_txn[idit->second]  = true;
+                    mempool_count++;
+                } else {
+                    // If we find two mempool txn that match the short id, just request it.
+                    // This should be rare enough that the extra bandwidth doesn't matter,
+                    // but eating a round-trip due to FillBlock failure would be annoying
+                    if (txn_available[idit->second]) {
+                        txn_available[idit->second].reset();
+                        mempool_count--;
+                    }
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids.size())
+                break;
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
     }
 
+    std::vector<const uint256*> extra_hashes(extra_txn.size());
+    for (size_t i = 0; i < extra_txn.size(); i++) {
+        extra_hashes[i] = &extra_txn[i].first;
+    }
+    std::vector<uint64_t> extra_shortids(extra_txn.size());
+    cmpctblock.GetShortIDs(extra_hashes.data(), extra_hashes.size(), extra_shortids.data());
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
+        uint64_t shortid = extra_shortids[i];
+        if (!maybe_in_block(shortid)) continue;
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
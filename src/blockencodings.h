@@ -152,6 +152,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** Compute the short IDs of count transaction hashes at once, which is faster than GetShortID for each */
+    void GetShortIDs(const uint256* const* txhashes, size_t count, uint64_t* shortids) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
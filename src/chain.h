@@ -14,8 +14,11 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <memory>
 #include <vector>
 
+struct LwmaWindow;
+
 /**
  * Maximum amount of time that a block timestamp is allowed to exceed the
  * current network-adjusted time before the block will be accepted.
@@ -189,6 +192,11 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) LWMA retarget window ending at this block, filled in lazily by GetLwmaWindow.
+    //! Only ever set for post-fork entries, so the rest of the index just carries a null pointer.
+    //! Written under cs_main, like every other caller of GetNextWorkRequired.
+    mutable std::shared_ptr<const LwmaWindow> lwmaWindow;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -204,6 +212,7 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        lwmaWindow.reset();
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
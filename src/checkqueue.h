@@ -9,6 +9,8 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -26,12 +28,23 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Verifications are appended to an array and handed out in chunks by
+  * advancing an atomic cursor over it, so that workers only take the mutex
+  * to go to sleep when they run out of work, and the master only takes it
+  * to wake them up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Number of verifications in each segment of the array
+    static constexpr uint32_t SEGMENT_SIZE = 4096;
+
+    //! Maximum number of segments, far more than the inputs of any block
+    static constexpr uint32_t MAX_SEGMENTS = 1024;
+
+    //! Mutex for sleeping and waking up workers and the master
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,88 +53,91 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The elements to be processed, in segments that are allocated when
+    //! first needed and never move, so that workers can read them while the
+    //! master appends.
+    std::unique_ptr<T[]> m_segments[MAX_SEGMENTS];
+
+    //! The number of elements added in the high 32 bits, and the index of
+    //! the next element to hand out in the low 32 bits. Updating both in one
+    //! word ensures that no element is handed out before it is added.
+    std::atomic<uint64_t> m_cursor{0};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of elements that have been processed.
+    std::atomic<uint32_t> m_done{0};
+
+    //! The number of workers (excluding the master) that are idle.
+    std::atomic<int> nIdle{0};
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal{0};
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Whether the master is waiting for the workers to finish.
+    std::atomic<bool> m_master_waiting{false};
 
-    /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
-     */
-    unsigned int nTodo;
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk{true};
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    T& At(uint32_t pos)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        return m_segments[pos / SEGMENT_SIZE][pos % SEGMENT_SIZE];
+    }
+
+    //! Whether there are elements that haven't been handed out yet.
+    bool HasWork() const
+    {
+        const uint64_t cursor = m_cursor.load();
+        return (uint32_t)cursor != (uint32_t)(cursor >> 32);
+    }
+
+    /** Take a batch of elements to process. Returns the number taken, which are at positions [begin, begin + count). */
+    uint32_t Take(uint32_t& begin)
+    {
+        uint64_t cursor = m_cursor.load();
+        while (true) {
+            const uint32_t next = cursor;
+            const uint32_t added = cursor >> 32;
+            if (next == added) return 0;
+            // Decide how many work units to process now.
+            // * Do not try to do everything at once, but aim for increasingly smaller batches so
+            //   all workers finish approximately simultaneously.
+            // * Try to account for idle jobs which will instantly start helping.
+            // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+            const uint32_t count = std::max(1U, std::min(nBatchSize, (unsigned int)((added - next) / (nTotal + nIdle + 1))));
+            if (m_cursor.compare_exchange_weak(cursor, cursor + count)) {
+                begin = next;
+                return count;
             }
-            // execute work
-            for (T& check : vChecks)
+        }
+    }
+
+    /** Process batches of elements until there are none left to take. */
+    void Work()
+    {
+        uint32_t begin;
+        while (uint32_t count = Take(begin)) {
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
+            for (uint32_t pos = begin; pos < begin + count; pos++) {
+                // Swap the element out so that it is destroyed here, before
+                // it is counted as done.
+                T check;
+                check.swap(At(pos));
                 if (fOk)
                     fOk = check();
-            vChecks.clear();
-        } while (true);
+            }
+            if (!fOk)
+                fAllOk = false;
+            const uint32_t done = m_done.fetch_add(count) + count;
+            if (m_master_waiting && done == (uint32_t)(m_cursor.load() >> 32)) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+        }
     }
 
 public:
@@ -129,33 +145,67 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        nTotal++;
+        while (true) {
+            Work();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nIdle++;
+            while (!HasWork()) {
+                condWorker.wait(lock); // wait
+            }
+            nIdle--;
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        nTotal++;
+        Work();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        m_master_waiting = true;
+        while (m_done != (uint32_t)(m_cursor.load() >> 32)) {
+            condMaster.wait(lock);
+        }
+        m_master_waiting = false;
+        nTotal--;
+        bool fRet = fAllOk;
+        // reset the status for new work later
+        m_cursor = 0;
+        m_done = 0;
+        fAllOk = true;
+        // return the current status
+        return fRet;
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        // Only the master adds elements, so the added count can't change under us
+        const uint32_t added = m_cursor.load() >> 32;
+        assert(added + vChecks.size() <= (uint64_t)SEGMENT_SIZE * MAX_SEGMENTS);
+        for (size_t i = 0; i < vChecks.size(); i++) {
+            const uint32_t pos = added + i;
+            if (!m_segments[pos / SEGMENT_SIZE]) {
+                m_segments[pos / SEGMENT_SIZE].reset(new T[SEGMENT_SIZE]);
+            }
+            At(pos).swap(vChecks[i]);
+        }
+        m_cursor += (uint64_t)vChecks.size() << 32;
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
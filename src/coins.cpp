@@ -13,7 +13,7 @@
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -28,7 +28,7 @@ bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return base->BatchWrite(mapCoins, hashBlock, erase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
@@ -57,6 +57,15 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin&& coin) {
+    auto ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (!ret.second) return;
+    if (ret.first->second.coin.IsSpent()) {
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
@@ -145,8 +154,8 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool erase) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
@@ -159,7 +168,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 // Otherwise we will need to create it in the parent
                 // and move the data up and mark it as dirty
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
+                entry.coin = erase ? std::move(it->second.coin) : it->second.coin;
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
                 // We can mark it FRESH in the parent if it was FRESH in the child
@@ -188,7 +197,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             } else {
                 // A normal modification.
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
+                itUs->second.coin = erase ? std::move(it->second.coin) : it->second.coin;
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 // NOTE: It is possible the child has a FRESH flag here in
@@ -210,6 +219,45 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync(size_t target_usage) {
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, /* erase */ false);
+    // The base now has every modification, so no entry is DIRTY or FRESH
+    // anymore, and spent entries are of no further use.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    // Entries are visited in (salted) hash order, starting where the previous
+    // trim stopped and wrapping around, so successive trims evict successive
+    // regions of the table rather than the same one every time. Erased entries
+    // only give their memory back once the map is compacted, so evict against
+    // a running estimate, compact, and go on should the map still be too big.
+    size_t usage = DynamicMemoryUsage();
+    while (usage > target_usage && !cacheCoins.empty()) {
+        CCoinsMap::iterator it = cacheCoins.begin_at(m_trim_slot);
+        while (usage > target_usage && !cacheCoins.empty()) {
+            if (it == cacheCoins.end()) it = cacheCoins.begin();
+            const size_t coin_usage = it->second.coin.DynamicMemoryUsage();
+            cachedCoinsUsage -= coin_usage;
+            usage -= std::min(usage, coin_usage + memusage::IncrementalDynamicUsage(cacheCoins));
+            it = cacheCoins.erase(it);
+        }
+        // Compacting shrinks the table by powers of two, which keeps the hash
+        // order, so the slot to continue from scales along.
+        const size_t slots = cacheCoins.slot_count();
+        const size_t trim_slot = cacheCoins.slot_of(it);
+        cacheCoins.compact();
+        m_trim_slot = slots == 0 ? 0 : trim_slot * cacheCoins.slot_count() / slots;
+        usage = DynamicMemoryUsage();
+    }
+    return fOk;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
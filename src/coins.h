@@ -19,6 +19,7 @@
 #include <stdint.h>
 
 #include <functional>
+#include <limits>
 #include <unordered_map>
 
 /**
@@ -97,13 +98,8 @@ public:
      * unordered_map will behave unpredictably if the custom hasher returns a
      * uint64_t, resulting in failures when syncing the chain (#4634).
      *
-     * Having the hash noexcept allows libstdc++'s unordered_map to recalculate
-     * the hash during rehash, so it does not have to cache the value. This
-     * reduces node's memory by sizeof(size_t). The required recalculation has
-     * a slight performance penalty (around 1.6%), but this is compensated by
-     * memory savings of about 9% which allow for a larger dbcache setting.
-     *
-     * @see https://gcc.gnu.org/onlinedocs/gcc-9.2.0/libstdc++/manual/manual/unordered_associative.html
+     * CCoinsMap only keeps 32 bits of the hash per entry and recalculates the
+     * hash of every entry when its table grows, so the hash must not throw.
      */
     size_t operator()(const COutPoint& id) const noexcept {
         return SipHashUint256Extra(k0, k1, id.hash, id.n);
@@ -129,7 +125,7 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef flatmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -174,8 +170,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. If erase is false, its entries
+    //! are left in place (unchanged) for the caller to keep using.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -201,7 +198,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -221,6 +218,9 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Slot of cacheCoins at which the next trim in Sync starts evicting. */
+    size_t m_trim_slot{0};
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -234,7 +234,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -246,6 +246,14 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add a coin that the caller read from the backing view to the cache, with
+     * the same effect as a cache miss in AccessCoin would have had. Does nothing
+     * if the outpoint is already cached. This lets callers fetch a batch of
+     * misses from the backing view concurrently before using the cache.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -278,6 +286,14 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush(),
+     * but keep the unspent entries cached, now unmodified, so the cache stays
+     * warm. Spent entries are dropped, and then arbitrary unmodified entries
+     * are evicted until the cache uses at most target_usage bytes.
+     */
+    bool Sync(size_t target_usage = std::numeric_limits<size_t>::max());
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
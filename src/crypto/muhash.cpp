@@ -0,0 +1,195 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <limits>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime number. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** Add a double limb sized value to a number, returning the carry out of its top limb. */
+limb_t AddDoubleLimb(limb_t (&limbs)[LIMBS], double_limb_t add)
+{
+    for (int i = 0; i < LIMBS && add; ++i) {
+        double_limb_t t = (double_limb_t)limbs[i] + (limb_t)add;
+        limbs[i] = (limb_t)t;
+        add = (add >> LIMB_SIZE) + (t >> LIMB_SIZE);
+    }
+    return (limb_t)add;
+}
+
+limb_t ReadLimb(const unsigned char* in)
+{
+    return LIMB_SIZE == 64 ? (limb_t)ReadLE64(in) : (limb_t)ReadLE32(in);
+}
+
+void WriteLimb(unsigned char* out, limb_t limb)
+{
+    if (LIMB_SIZE == 64) {
+        WriteLE64(out, (uint64_t)limb);
+    } else {
+        WriteLE32(out, (uint32_t)limb);
+    }
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLimb(data + (LIMB_SIZE / 8) * i);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is the same as adding MAX_PRIME_DIFF and
+    // dropping the 2^3072 bit.
+    AddDoubleLimb(limbs, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into a double width result.
+    limb_t tmp[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // With tmp = hi * 2^3072 + lo, and 2^3072 == MAX_PRIME_DIFF modulo the
+    // prime, fold the high half back in as lo + hi * MAX_PRIME_DIFF.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)tmp[LIMBS + i] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    // Same for what overflowed out of the top limb. The second round can only
+    // be needed when the value is just below 2^3072, and never carries itself.
+    while (carry) {
+        carry = AddDoubleLimb(limbs, (double_limb_t)carry * MAX_PRIME_DIFF);
+    }
+
+    // The value is now below 2^3072 < 2 * prime, so one subtraction suffices.
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, the inverse of a is a^(p - 2) mod p.
+    limb_t exponent[LIMBS];
+    exponent[0] = (limb_t)0 - MAX_PRIME_DIFF - 2;
+    for (int i = 1; i < LIMBS; ++i) {
+        exponent[i] = std::numeric_limits<limb_t>::max();
+    }
+
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        for (int bit = LIMB_SIZE - 1; bit >= 0; --bit) {
+            Num3072 square(result);
+            result.Multiply(square);
+            if ((exponent[i] >> bit) & 1) {
+                result.Multiply(*this);
+            }
+        }
+    }
+    return result;
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE])
+{
+    if (IsOverflow()) FullReduce();
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLimb(out + (LIMB_SIZE / 8) * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char tmp[Num3072::BYTE_SIZE];
+
+    uint256 hashed_in;
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in.begin());
+    ChaCha20(hashed_in.begin(), hashed_in.size()).Keystream(tmp, Num3072::BYTE_SIZE);
+    Num3072 out{tmp};
+
+    return out;
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in) noexcept
+{
+    m_numerator = ToNum3072(in);
+}
+
+void MuHash3072::Finalize(uint256& out) noexcept
+{
+    m_numerator.Multiply(m_denominator.GetInverse());
+    m_denominator.SetToOne();  // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, Num3072::BYTE_SIZE).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul) noexcept
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div) noexcept
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in) noexcept
+{
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in) noexcept
+{
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+
+public:
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    static constexpr size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    /** Multiply by a, modulo 2^3072 - 1103717. */
+    void Multiply(const Num3072& a);
+    /** Return the multiplicative inverse, modulo 2^3072 - 1103717. */
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        for (limb_t& limb : limbs) {
+            READWRITE(limb);
+        }
+    }
+};
+
+/** A class representing MuHash sets
+ *
+ * MuHash is a hashing algorithm that supports adding set elements in any
+ * order but also deleting in any order. As a result, it can maintain a
+ * running sum for a set of data as a whole, and add/remove when data
+ * is added to or removed from it. A downside of MuHash is that computing
+ * an inverse is relatively expensive. This is solved by representing
+ * the running value as a fraction, and multiplying added elements into
+ * the numerator and removed elements into the denominator. Only when the
+ * final hash is desired, a single modular inverse and multiplication is
+ * needed to combine the two. Serialization stores the numerator and the
+ * denominator separately, so that a deserialized object can still be
+ * updated without computing an inverse.
+ *
+ * Elements are hashed with SHA256, expanded to 3072 bits with ChaCha20 and
+ * multiplied together modulo the largest 3072-bit safe prime,
+ * 2^3072 - 1103717. See https://cseweb.ucsd.edu/~mihir/papers/inchash.pdf
+ * for the construction.
+ */
+class MuHash3072
+{
+private:
+    Num3072 m_numerator;
+    Num3072 m_denominator;
+
+    Num3072 ToNum3072(Span<const unsigned char> in);
+
+public:
+    /* The empty set. */
+    MuHash3072() noexcept {};
+
+    /* A singleton with variable sized data in it. */
+    explicit MuHash3072(Span<const unsigned char> in) noexcept;
+
+    /* Insert a single piece of data into the set. */
+    MuHash3072& Insert(Span<const unsigned char> in) noexcept;
+
+    /* Remove a single piece of data from the set. */
+    MuHash3072& Remove(Span<const unsigned char> in) noexcept;
+
+    /* Multiply (resulting in a hash for the union of the sets) */
+    MuHash3072& operator*=(const MuHash3072& mul) noexcept;
+
+    /* Divide (resulting in a hash for the difference of the sets) */
+    MuHash3072& operator/=(const MuHash3072& div) noexcept;
+
+    /* Finalize into a 32-byte hash. Folds the denominator into the numerator,
+     * but does not change the set this object represents. */
+    void Finalize(uint256& out) noexcept;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(m_numerator);
+        READWRITE(m_denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -38,6 +38,12 @@ void Transform_2way(unsigned char* out, const unsigned char* in);
 namespace sha256_shani
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void Transform_2way(uint32_t* const* s, const unsigned char* const* chunks);
+}
+
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* const* s, const unsigned char* const* chunks);
 }
 
 // Internal implementation code.
@@ -417,6 +423,7 @@ void TransformD64(unsigned char* out, const unsigned char* in)
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
 typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+typedef void (*TransformMultiType)(uint32_t* const*, const unsigned char* const*);
 
 template<TransformType tr>
 void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
@@ -462,6 +469,94 @@ TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformMultiType Transform_2way = nullptr;
+TransformMultiType Transform_8way = nullptr;
+
+/** Double-SHA256 of count messages, hashing one block of each of LANES messages per call to tr. */
+template<size_t LANES>
+void SHA256DMultiway(TransformMultiType tr, unsigned char* const* out, const unsigned char* const* in, const size_t* len, size_t count)
+{
+    struct Lane {
+        uint32_t s[8];
+        const unsigned char* data; // Next full block of the message
+        size_t blocks; // Full blocks of the message left
+        unsigned char tail[128]; // Last part of the message and its padding
+        const unsigned char* tail_pos; // Next block in tail
+        size_t tail_blocks; // Blocks in tail left
+        size_t msg; // Index of the message
+        bool second; // Whether this is the second SHA256 of the message
+        bool active;
+    };
+    static const unsigned char idle_chunk[64] = {0};
+    Lane lanes[LANES];
+    uint32_t idle_state[8] = {};
+    uint32_t* states[LANES];
+    const unsigned char* chunks[LANES];
+    size_t next = 0;
+    for (size_t l = 0; l < LANES; ++l) lanes[l].active = false;
+
+    while (true) {
+        bool any = false;
+        for (size_t l = 0; l < LANES; ++l) {
+            Lane& lane = lanes[l];
+            if (!lane.active && next < count) {
+                // Start the next message in this lane
+                const size_t rem = len[next] % 64;
+                lane.msg = next;
+                lane.data = in[next];
+                lane.blocks = len[next] / 64;
+                memset(lane.tail, 0, sizeof(lane.tail));
+                if (rem) memcpy(lane.tail, in[next] + lane.blocks * 64, rem);
+                lane.tail[rem] = 0x80;
+                lane.tail_blocks = rem + 9 <= 64 ? 1 : 2;
+                WriteBE64(lane.tail + lane.tail_blocks * 64 - 8, ((uint64_t)len[next]) << 3);
+                lane.tail_pos = lane.tail;
+                lane.second = false;
+                lane.active = true;
+                sha256::Initialize(lane.s);
+                ++next;
+            }
+            if (lane.active) {
+                states[l] = lane.s;
+                chunks[l] = lane.blocks ? lane.data : lane.tail_pos;
+                any = true;
+            } else {
+                states[l] = idle_state;
+                chunks[l] = idle_chunk;
+            }
+        }
+        if (!any) break;
+
+        tr(states, chunks);
+
+        for (size_t l = 0; l < LANES; ++l) {
+            Lane& lane = lanes[l];
+            if (!lane.active) continue;
+            if (lane.blocks) {
+                --lane.blocks;
+                lane.data += 64;
+            } else {
+                --lane.tail_blocks;
+                lane.tail_pos += 64;
+            }
+            if (lane.blocks || lane.tail_blocks) continue;
+            if (!lane.second) {
+                // Hash the 32-byte result again
+                for (int i = 0; i < 8; ++i) WriteBE32(lane.tail + 4 * i, lane.s[i]);
+                memset(lane.tail + 32, 0, 32);
+                lane.tail[32] = 0x80;
+                WriteBE64(lane.tail + 56, 256);
+                lane.tail_pos = lane.tail;
+                lane.tail_blocks = 1;
+                lane.second = true;
+                sha256::Initialize(lane.s);
+            } else {
+                for (int i = 0; i < 8; ++i) WriteBE32(out[lane.msg] + 4 * i, lane.s[i]);
+                lane.active = false;
+            }
+        }
+    }
+}
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -545,6 +640,25 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test Transform_2way and Transform_8way, if available, continuing from
+    // each of the intermediate states above in a separate lane.
+    for (size_t lanes : {2, 8}) {
+        TransformMultiType tr = lanes == 2 ? Transform_2way : Transform_8way;
+        if (!tr) continue;
+        uint32_t state[8][8];
+        uint32_t* states[8];
+        const unsigned char* chunks[8];
+        for (size_t i = 0; i < lanes; ++i) {
+            std::copy(result[i], result[i] + 8, state[i]);
+            states[i] = state[i];
+            chunks[i] = data + 1 + 64 * i;
+        }
+        tr(states, chunks);
+        for (size_t i = 0; i < lanes; ++i) {
+            if (!std::equal(state[i], state[i] + 8, result[i + 1])) return false;
+        }
+    }
+
     return true;
 }
 
@@ -609,7 +723,8 @@ std::string SHA256AutoDetect()
         Transform = sha256_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
         TransformD64_2way = sha256d64_shani::Transform_2way;
-        ret = "shani(1way,2way)";
+        Transform_2way = sha256_shani::Transform_2way;
+        ret = "shani(1way,2way,2waymulti)";
         have_sse4 = false; // Disable SSE4/AVX2;
         have_avx2 = false;
     }
@@ -630,7 +745,8 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
-        ret += ",avx2(8way)";
+        Transform_8way = sha256_avx2::Transform_8way;
+        ret += ",avx2(8way,8waymulti)";
     }
 #endif
 #endif
@@ -729,3 +845,18 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256DBatch(unsigned char* const* output, const unsigned char* const* input, const size_t* len, size_t count)
+{
+    if (Transform_8way) {
+        SHA256DMultiway<8>(Transform_8way, output, input, len, count);
+    } else if (Transform_2way) {
+        SHA256DMultiway<2>(Transform_2way, output, input, len, count);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(input[i], len[i]).Finalize(hash);
+            CSHA256().Write(hash, sizeof(hash)).Finalize(output[i]);
+        }
+    }
+}
@@ -39,4 +39,13 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute multiple double-SHA256's of messages of any length, several at once
+ *  where a multi-lane implementation is available.
+ *  output:  pointers to count 32 byte output buffers
+ *  input:   pointers to count messages
+ *  len:     the lengths of the count messages
+ *  count:   the number of hashes to compute.
+ */
+void SHA256DBatch(unsigned char* const* output, const unsigned char* const* input, const size_t* len, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
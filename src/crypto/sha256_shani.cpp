@@ -141,6 +141,110 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
     _mm_storeu_si128((__m128i*)s, s0);
     _mm_storeu_si128((__m128i*)(s + 4), s1);
 }
+
+void Transform_2way(uint32_t* const* s, const unsigned char* const* chunks)
+{
+    __m128i am0, am1, am2, am3, as0, as1, aso0, aso1;
+    __m128i bm0, bm1, bm2, bm3, bs0, bs1, bso0, bso1;
+
+    /* Load state */
+    as0 = _mm_loadu_si128((const __m128i*)s[0]);
+    as1 = _mm_loadu_si128((const __m128i*)(s[0] + 4));
+    bs0 = _mm_loadu_si128((const __m128i*)s[1]);
+    bs1 = _mm_loadu_si128((const __m128i*)(s[1] + 4));
+    Shuffle(as0, as1);
+    Shuffle(bs0, bs1);
+
+    /* Remember old state */
+    aso0 = as0;
+    aso1 = as1;
+    bso0 = bs0;
+    bso1 = bs1;
+
+    /* Load data and transform */
+    am0 = Load(chunks[0]);
+    bm0 = Load(chunks[1]);
+    QuadRound(as0, as1, am0, 0xe9b5dba5b5c0fbcfull, 0x71374491428a2f98ull);
+    QuadRound(bs0, bs1, bm0, 0xe9b5dba5b5c0fbcfull, 0x71374491428a2f98ull);
+    am1 = Load(chunks[0] + 16);
+    bm1 = Load(chunks[1] + 16);
+    QuadRound(as0, as1, am1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    QuadRound(bs0, bs1, bm1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    ShiftMessageA(am0, am1);
+    ShiftMessageA(bm0, bm1);
+    am2 = Load(chunks[0] + 32);
+    bm2 = Load(chunks[1] + 32);
+    QuadRound(as0, as1, am2, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    QuadRound(bs0, bs1, bm2, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    ShiftMessageA(am1, am2);
+    ShiftMessageA(bm1, bm2);
+    am3 = Load(chunks[0] + 48);
+    bm3 = Load(chunks[1] + 48);
+    QuadRound(as0, as1, am3, 0xc19bf1749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    QuadRound(bs0, bs1, bm3, 0xc19bf1749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 0x240ca1cc0fc19dc6ull, 0xefbe4786E49b69c1ull);
+    QuadRound(bs0, bs1, bm0, 0x240ca1cc0fc19dc6ull, 0xefbe4786E49b69c1ull);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 0x76f988da5cb0a9dcull, 0x4a7484aa2de92c6full);
+    QuadRound(bs0, bs1, bm1, 0x76f988da5cb0a9dcull, 0x4a7484aa2de92c6full);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 0xbf597fc7b00327c8ull, 0xa831c66d983e5152ull);
+    QuadRound(bs0, bs1, bm2, 0xbf597fc7b00327c8ull, 0xa831c66d983e5152ull);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 0x1429296706ca6351ull, 0xd5a79147c6e00bf3ull);
+    QuadRound(bs0, bs1, bm3, 0x1429296706ca6351ull, 0xd5a79147c6e00bf3ull);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 0x53380d134d2c6dfcull, 0x2e1b213827b70a85ull);
+    QuadRound(bs0, bs1, bm0, 0x53380d134d2c6dfcull, 0x2e1b213827b70a85ull);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 0x92722c8581c2c92eull, 0x766a0abb650a7354ull);
+    QuadRound(bs0, bs1, bm1, 0x92722c8581c2c92eull, 0x766a0abb650a7354ull);
+    ShiftMessageB(am0, am1, am2);
+    ShiftMessageB(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 0xc76c51A3c24b8b70ull, 0xa81a664ba2bfe8a1ull);
+    QuadRound(bs0, bs1, bm2, 0xc76c51A3c24b8b70ull, 0xa81a664ba2bfe8a1ull);
+    ShiftMessageB(am1, am2, am3);
+    ShiftMessageB(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 0x106aa070f40e3585ull, 0xd6990624d192e819ull);
+    QuadRound(bs0, bs1, bm3, 0x106aa070f40e3585ull, 0xd6990624d192e819ull);
+    ShiftMessageB(am2, am3, am0);
+    ShiftMessageB(bm2, bm3, bm0);
+    QuadRound(as0, as1, am0, 0x34b0bcb52748774cull, 0x1e376c0819a4c116ull);
+    QuadRound(bs0, bs1, bm0, 0x34b0bcb52748774cull, 0x1e376c0819a4c116ull);
+    ShiftMessageB(am3, am0, am1);
+    ShiftMessageB(bm3, bm0, bm1);
+    QuadRound(as0, as1, am1, 0x682e6ff35b9cca4full, 0x4ed8aa4a391c0cb3ull);
+    QuadRound(bs0, bs1, bm1, 0x682e6ff35b9cca4full, 0x4ed8aa4a391c0cb3ull);
+    ShiftMessageC(am0, am1, am2);
+    ShiftMessageC(bm0, bm1, bm2);
+    QuadRound(as0, as1, am2, 0x8cc7020884c87814ull, 0x78a5636f748f82eeull);
+    QuadRound(bs0, bs1, bm2, 0x8cc7020884c87814ull, 0x78a5636f748f82eeull);
+    ShiftMessageC(am1, am2, am3);
+    ShiftMessageC(bm1, bm2, bm3);
+    QuadRound(as0, as1, am3, 0xc67178f2bef9A3f7ull, 0xa4506ceb90befffaull);
+    QuadRound(bs0, bs1, bm3, 0xc67178f2bef9A3f7ull, 0xa4506ceb90befffaull);
+
+    /* Combine with old state */
+    as0 = _mm_add_epi32(as0, aso0);
+    as1 = _mm_add_epi32(as1, aso1);
+    bs0 = _mm_add_epi32(bs0, bso0);
+    bs1 = _mm_add_epi32(bs1, bso1);
+
+    /* Save state */
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    _mm_storeu_si128((__m128i*)s[0], as0);
+    _mm_storeu_si128((__m128i*)(s[0] + 4), as1);
+    _mm_storeu_si128((__m128i*)s[1], bs0);
+    _mm_storeu_si128((__m128i*)(s[1] + 4), bs1);
+}
 }
 
 namespace sha256d64_shani {
@@ -4,6 +4,21 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <crypto/siphash.h>
+#include <crypto/common.h>
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+namespace siphash_sse41
+{
+void SipHashUint256_2way(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out);
+}
+
+namespace siphash_avx2
+{
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out);
+}
 
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
@@ -172,3 +187,76 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+typedef void (*SipHashUint256MultiType)(uint64_t, uint64_t, const uint256* const*, const uint32_t*, uint64_t*);
+
+/** The widest multi-lane implementation supported by this CPU, or nullptr if none. */
+struct SipHashUint256Multi
+{
+    SipHashUint256MultiType fn = nullptr;
+    size_t lanes = 1;
+
+    SipHashUint256Multi()
+    {
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+        uint32_t eax, ebx, ecx, edx;
+        __cpuid_count(1, 0, eax, ebx, ecx, edx);
+        const bool have_sse4 = (ecx >> 19) & 1;
+        bool enabled_avx = false;
+        if (((ecx >> 27) & 1) && ((ecx >> 28) & 1)) {
+            // Check whether the OS has enabled AVX registers.
+            uint32_t a, d;
+            __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+            enabled_avx = (a & 6) == 6;
+        }
+        bool have_avx2 = false;
+        if (have_sse4) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = (ebx >> 5) & 1;
+        }
+        (void)have_sse4;
+        (void)have_avx2;
+        (void)enabled_avx;
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+        if (have_sse4) {
+            fn = siphash_sse41::SipHashUint256_2way;
+            lanes = 2;
+        }
+#endif
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+        if (have_avx2 && enabled_avx) {
+            fn = siphash_avx2::SipHashUint256_4way;
+            lanes = 4;
+        }
+#endif
+#endif
+    }
+};
+
+void SipHashUint256BatchImpl(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, size_t count, uint64_t* out)
+{
+    static const SipHashUint256Multi multi;
+    size_t i = 0;
+    if (multi.fn) {
+        for (; i + multi.lanes <= count; i += multi.lanes) {
+            multi.fn(k0, k1, vals + i, extras ? extras + i : nullptr, out + i);
+        }
+    }
+    for (; i < count; ++i) {
+        out[i] = extras ? SipHashUint256Extra(k0, k1, *vals[i], extras[i]) : SipHashUint256(k0, k1, *vals[i]);
+    }
+}
+
+} // namespace
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out)
+{
+    SipHashUint256BatchImpl(k0, k1, vals, nullptr, count, out);
+}
+
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, size_t count, uint64_t* out)
+{
+    SipHashUint256BatchImpl(k0, k1, vals, extras, count, out);
+}
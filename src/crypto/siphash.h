@@ -45,4 +45,13 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute SipHashUint256 of count values at once, writing the results to out.
+ *
+ *  Several values are hashed in parallel with SSE4.1 or AVX2 when the CPU
+ *  supports it, which makes this faster than a loop for more than a few values.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out);
+/** Compute SipHashUint256Extra of count values at once; see SipHashUint256Batch. */
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, size_t count, uint64_t* out);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
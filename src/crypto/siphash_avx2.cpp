@@ -0,0 +1,70 @@
+#ifdef ENABLE_AVX2
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <uint256.h>
+
+namespace siphash_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+__m256i inline RotL16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_set_epi8(13, 12, 11, 10, 9, 8, 15, 14, 5, 4, 3, 2, 1, 0, 7, 6, 13, 12, 11, 10, 9, 8, 15, 14, 5, 4, 3, 2, 1, 0, 7, 6)); }
+__m256i inline RotL32(__m256i x) { return _mm256_shuffle_epi32(x, 0xb1); }
+
+void inline SipRound(__m256i& v0, __m256i& v1, __m256i& v2, __m256i& v3)
+{
+    v0 = Add(v0, v1); v1 = RotL(v1, 13); v1 = Xor(v1, v0);
+    v0 = RotL32(v0);
+    v2 = Add(v2, v3); v3 = RotL16(v3); v3 = Xor(v3, v2);
+    v0 = Add(v0, v3); v3 = RotL(v3, 21); v3 = Xor(v3, v0);
+    v2 = Add(v2, v1); v1 = RotL(v1, 17); v1 = Xor(v1, v2);
+    v2 = RotL32(v2);
+}
+
+void inline Compress(__m256i& v0, __m256i& v1, __m256i& v2, __m256i& v3, __m256i d)
+{
+    v3 = Xor(v3, d);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 = Xor(v0, d);
+}
+
+__m256i inline Word(const uint256* const* vals, int pos)
+{
+    return _mm256_set_epi64x(vals[3]->GetUint64(pos), vals[2]->GetUint64(pos), vals[1]->GetUint64(pos), vals[0]->GetUint64(pos));
+}
+
+}
+
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out)
+{
+    __m256i v0 = K(0x736f6d6570736575ULL ^ k0);
+    __m256i v1 = K(0x646f72616e646f6dULL ^ k1);
+    __m256i v2 = K(0x6c7967656e657261ULL ^ k0);
+    __m256i v3 = K(0x7465646279746573ULL ^ k1);
+
+    Compress(v0, v1, v2, v3, Word(vals, 0));
+    Compress(v0, v1, v2, v3, Word(vals, 1));
+    Compress(v0, v1, v2, v3, Word(vals, 2));
+    Compress(v0, v1, v2, v3, Word(vals, 3));
+    if (extras) {
+        Compress(v0, v1, v2, v3, _mm256_set_epi64x((((uint64_t)36) << 56) | extras[3], (((uint64_t)36) << 56) | extras[2], (((uint64_t)36) << 56) | extras[1], (((uint64_t)36) << 56) | extras[0]));
+    } else {
+        Compress(v0, v1, v2, v3, K(((uint64_t)4) << 59));
+    }
+    v2 = Xor(v2, K(0xFF));
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    _mm256_storeu_si256((__m256i*)out, Xor(Xor(v0, v1), Xor(v2, v3)));
+}
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <cmath>
 #include <cstring>
 #include <memory>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -23,6 +24,9 @@
  * 2) cache is a cache which is performant in memory usage and lookup speed. It
  * is lockfree for erase operations. Elements are lazily erased on the next
  * insert.
+ *
+ * 3) concurrent_cache is a cache whose reads, erases and inserts may all run
+ * concurrently without external locking.
  */
 namespace CuckooCache
 {
@@ -475,6 +479,337 @@ public:
             }
         return false;
     }
+
+    /** elements returns the elements which have not been erased, those of the
+     * older epoch first, e.g. to persist the cache. Inserting them in this
+     * order into a new cache keeps the recent ones longest.
+     *
+     * Requires no concurrent Write.
+     */
+    std::vector<Element> elements() const
+    {
+        std::vector<Element> ret;
+        for (const bool recent : {false, true})
+            for (uint32_t i = 0; i < size; ++i)
+                if (epoch_flags[i] == recent && !collection_flags.bit_is_set(i))
+                    ret.push_back(table[i]);
+        return ret;
+    }
+};
+
+/** concurrent_cache is a variant of cache for which all operations but setup
+ * may be called concurrently, without any external synchronization.
+ *
+ * Every slot has a sequence number, which is odd while a writer owns the slot.
+ * Writers claim a slot with a compare-and-swap and never wait for one: when an
+ * insert needs a slot owned by another writer, it drops the element it carries
+ * (which cache also does once it runs out of depth). Readers copy a slot and
+ * check that its sequence number was even and did not change meanwhile;
+ * otherwise the read counts as a miss. A concurrent insert can thus cause a
+ * false miss, but never a false hit, which is what a cache of verification
+ * results needs.
+ *
+ * Elements are stored as std::atomic<uint64_t> words, so Element must be
+ * trivially copyable with a size that is a multiple of 8 bytes.
+ *
+ * Epochs are aged as in cache. The scan is done by the insert that runs
+ * the heuristic counter out; inserts meanwhile skip the check.
+ *
+ * @tparam Element see cache
+ * @tparam Hash see cache
+ */
+template <typename Element, typename Hash>
+class concurrent_cache
+{
+private:
+    static_assert(std::is_trivially_copyable<Element>::value, "concurrent_cache elements are copied word by word");
+    static_assert(sizeof(Element) % sizeof(uint64_t) == 0, "concurrent_cache elements are copied word by word");
+
+    static constexpr size_t WORDS = sizeof(Element) / sizeof(uint64_t);
+
+    struct slot {
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    /** table stores all the elements */
+    std::unique_ptr<slot[]> table;
+
+    /** sequences stores the sequence number of each slot, odd while written */
+    std::unique_ptr<std::atomic<uint32_t>[]> sequences;
+
+    /** size stores the total available slots in the hash table */
+    uint32_t size;
+
+    /** see cache::collection_flags */
+    mutable bit_packed_atomic_flags collection_flags;
+
+    /** old_epoch_flags is the inverse of cache::epoch_flags: set denotes
+     * not-recent, which is also how bit_packed_atomic_flags start out. */
+    bit_packed_atomic_flags old_epoch_flags;
+
+    /** see cache::epoch_heuristic_counter */
+    std::atomic<uint32_t> epoch_heuristic_counter;
+
+    /** epoch_scanning is set while an insert does the epoch scan */
+    std::atomic<bool> epoch_scanning;
+
+    /** see cache::epoch_size */
+    uint32_t epoch_size;
+
+    /** see cache::depth_limit */
+    uint8_t depth_limit;
+
+    /** evicted counts the elements that were dropped or aged out of the table
+     * before they were erased */
+    std::atomic<uint64_t> evicted;
+
+    /** see cache::hash_function */
+    const Hash hash_function;
+
+    /** see cache::compute_hashes */
+    inline std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    {
+        return {{(uint32_t)(((uint64_t)hash_function.template operator()<0>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<1>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<2>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<3>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<4>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<5>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<6>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<7>(e) * (uint64_t)size) >> 32)}};
+    }
+
+    /* end
+     * @returns a constexpr index that can never be inserted to */
+    constexpr uint32_t invalid() const
+    {
+        return ~(uint32_t)0;
+    }
+
+    /** try_lock claims the slot at index n for writing, unless another writer
+     * owns it.
+     * @returns whether the slot was claimed
+     */
+    inline bool try_lock(uint32_t n)
+    {
+        uint32_t seq = sequences[n].load(std::memory_order_relaxed);
+        if ((seq & 1) || !sequences[n].compare_exchange_strong(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return false;
+        // Order the writes to the slot after the odd sequence number.
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    /** unlock publishes the writes to the slot at index n, claimed with try_lock */
+    inline void unlock(uint32_t n)
+    {
+        sequences[n].fetch_add(1, std::memory_order_release);
+    }
+
+    /** load copies the slot at index n, which the caller has claimed (or
+     * validates the copy of, see read) */
+    inline Element load(uint32_t n) const
+    {
+        uint64_t words[WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+            words[i] = table[n].words[i].load(std::memory_order_relaxed);
+        Element e;
+        std::memcpy(&e, words, sizeof(Element));
+        return e;
+    }
+
+    /** store writes e to the slot at index n, which the caller has claimed */
+    inline void store(uint32_t n, const Element& e)
+    {
+        uint64_t words[WORDS];
+        std::memcpy(words, &e, sizeof(Element));
+        for (size_t i = 0; i < WORDS; ++i)
+            table[n].words[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    /** read copies the slot at index n to e, without claiming it.
+     * @returns false if a writer owned the slot while reading
+     */
+    inline bool read(uint32_t n, Element& e) const
+    {
+        const uint32_t seq = sequences[n].load(std::memory_order_acquire);
+        if (seq & 1)
+            return false;
+        e = load(n);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequences[n].load(std::memory_order_relaxed) == seq;
+    }
+
+    /** matches checks whether the slot at index n holds e, without claiming it.
+     * @returns false if e is not there, or a writer owned the slot while reading
+     */
+    inline bool matches(uint32_t n, const Element& e) const
+    {
+        Element found;
+        return read(n, found) && found == e;
+    }
+
+    /** set_epoch marks the element at index n as recent or not-recent */
+    inline void set_epoch(uint32_t n, bool recent)
+    {
+        if (recent)
+            old_epoch_flags.bit_unset(n);
+        else
+            old_epoch_flags.bit_set(n);
+    }
+
+    /** see cache::epoch_check. The expensive scan is done by one insert at a
+     * time, and races with concurrent inserts, which is fine for a heuristic.
+     */
+    void epoch_check()
+    {
+        uint32_t counter = epoch_heuristic_counter.load(std::memory_order_relaxed);
+        while (counter != 0 && !epoch_heuristic_counter.compare_exchange_weak(counter, counter - 1, std::memory_order_relaxed)) {
+        }
+        if (counter != 0 || epoch_scanning.exchange(true, std::memory_order_acquire))
+            return;
+        uint32_t epoch_unused_count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            epoch_unused_count += !old_epoch_flags.bit_is_set(i) &&
+                                  !collection_flags.bit_is_set(i);
+        if (epoch_unused_count >= epoch_size) {
+            uint64_t expired = 0;
+            for (uint32_t i = 0; i < size; ++i) {
+                if (!old_epoch_flags.bit_is_set(i)) {
+                    old_epoch_flags.bit_set(i);
+                } else if (!collection_flags.bit_is_set(i)) {
+                    collection_flags.bit_set(i);
+                    ++expired;
+                }
+            }
+            evicted.fetch_add(expired, std::memory_order_relaxed);
+            epoch_heuristic_counter.store(epoch_size, std::memory_order_relaxed);
+        } else {
+            epoch_heuristic_counter.store(std::max(1u, std::max(epoch_size / 16,
+                        epoch_size - epoch_unused_count)), std::memory_order_relaxed);
+        }
+        epoch_scanning.store(false, std::memory_order_release);
+    }
+
+public:
+    /** You must always construct a cache with some elements via a subsequent
+     * call to setup or setup_bytes, otherwise operations may segfault.
+     */
+    concurrent_cache() : table(), sequences(), size(), collection_flags(0), old_epoch_flags(0),
+    epoch_heuristic_counter(0), epoch_scanning(false), epoch_size(), depth_limit(0), evicted(0), hash_function()
+    {
+    }
+
+    /** see cache::setup. Not threadsafe. */
+    uint32_t setup(uint32_t new_size)
+    {
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
+        size = std::max<uint32_t>(2, new_size);
+        table.reset(new slot[size]());
+        sequences.reset(new std::atomic<uint32_t>[size]());
+        collection_flags.setup(size);
+        old_epoch_flags.setup(size);
+        epoch_size = std::max((uint32_t)1, (45 * size) / 100);
+        epoch_heuristic_counter.store(epoch_size, std::memory_order_relaxed);
+        return size;
+    }
+
+    /** see cache::setup_bytes. Unlike the flags, the 4 byte sequence number
+     * per element is accounted for, as it adds an eighth to the size of a
+     * 32 byte element. Not threadsafe.
+     */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(bytes/(sizeof(slot) + sizeof(std::atomic<uint32_t>)));
+    }
+
+    /** see cache::insert. Displaced elements are moved one slot at a time, so
+     * concurrent readers may miss an element while it is being moved.
+     *
+     * @param e the element to insert
+     */
+    inline void insert(Element e)
+    {
+        epoch_check();
+        uint32_t last_loc = invalid();
+        bool last_epoch = true;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (const uint32_t loc : locs)
+            if (matches(loc, e)) {
+                collection_flags.bit_unset(loc);
+                set_epoch(loc, last_epoch);
+                return;
+            }
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            for (const uint32_t loc : locs) {
+                if (!collection_flags.bit_is_set(loc) || !try_lock(loc))
+                    continue;
+                // Another insert may have taken the slot before we claimed it.
+                if (!collection_flags.bit_is_set(loc)) {
+                    unlock(loc);
+                    continue;
+                }
+                store(loc, e);
+                collection_flags.bit_unset(loc);
+                set_epoch(loc, last_epoch);
+                unlock(loc);
+                return;
+            }
+            // See cache::insert for the choice of the slot to swap with.
+            last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
+            if (!try_lock(last_loc))
+                break;
+            const Element displaced = load(last_loc);
+            store(last_loc, e);
+            collection_flags.bit_unset(last_loc);
+            const bool epoch = !old_epoch_flags.bit_is_set(last_loc);
+            set_epoch(last_loc, last_epoch);
+            unlock(last_loc);
+            e = displaced;
+            last_epoch = epoch;
+
+            locs = compute_hashes(e);
+        }
+        evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** see cache::contains. Threadsafe, also with concurrent inserts.
+     *
+     * @param e the element to check
+     * @param erase whether to allow the element to be discarded
+     * @returns true if the element is found, false otherwise
+     */
+    inline bool contains(const Element& e, const bool erase) const
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (const uint32_t loc : locs)
+            if (matches(loc, e)) {
+                if (erase)
+                    collection_flags.bit_set(loc);
+                return true;
+            }
+        return false;
+    }
+
+    /** see cache::elements. Threadsafe, but elements which are inserted or
+     * moved concurrently may be missing. */
+    std::vector<Element> elements() const
+    {
+        std::vector<Element> ret;
+        Element e;
+        for (const bool recent : {false, true})
+            for (uint32_t i = 0; i < size; ++i)
+                if (old_epoch_flags.bit_is_set(i) != recent && !collection_flags.bit_is_set(i) && read(i, e))
+                    ret.push_back(e);
+        return ret;
+    }
+
+    /** evictions returns the number of elements that left the table without
+     * having been erased: dropped by an insert, or aged out by epoch_check. */
+    uint64_t evictions() const
+    {
+        return evicted.load(std::memory_order_relaxed);
+    }
 };
 } // namespace CuckooCache
 
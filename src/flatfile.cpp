@@ -4,8 +4,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <cstring>
 #include <stdexcept>
 
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+#include <compat.h>
 #include <flatfile.h>
 #include <logging.h>
 #include <tinyformat.h>
@@ -97,3 +103,79 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+MappedFlatFile::~MappedFlatFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+FlatFileMapCache::FlatFileMapCache(FlatFileSeq seq, size_t max_files) :
+    m_seq(std::move(seq)),
+    m_max_files(max_files)
+{
+}
+
+std::shared_ptr<const MappedFlatFile> FlatFileMapCache::Map(int file) const
+{
+#ifndef WIN32
+    fs::path path = m_seq.FileName(FlatFilePos(file, 0));
+    int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::make_shared<const MappedFlatFile>(static_cast<const unsigned char*>(data), st.st_size);
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile> FlatFileMapCache::Get(int file, size_t min_size)
+{
+    LOCK(m_mutex);
+    auto it = m_files.find(file);
+    if (it != m_files.end()) {
+        if (it->second->second->size() >= min_size) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->second;
+        }
+        // The file has grown since it was mapped.
+        m_lru.erase(it->second);
+        m_files.erase(it);
+    }
+
+    std::shared_ptr<const MappedFlatFile> mapped = Map(file);
+    if (!mapped || mapped->size() < min_size) {
+        return nullptr;
+    }
+    m_lru.emplace_front(file, mapped);
+    m_files.emplace(file, m_lru.begin());
+    while (m_lru.size() > m_max_files) {
+        m_files.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+    return mapped;
+}
+
+void FlatFileMapCache::Erase(int file)
+{
+    LOCK(m_mutex);
+    auto it = m_files.find(file);
+    if (it != m_files.end()) {
+        m_lru.erase(it->second);
+        m_files.erase(it);
+    }
+}
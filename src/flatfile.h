@@ -7,10 +7,15 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -94,4 +99,68 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/**
+ * A read-only memory mapping of one file of a FlatFileSeq. The mapping is
+ * released when the last reference to it goes away, so readers holding a
+ * shared_ptr can keep using its memory after it was evicted from the cache.
+ */
+class MappedFlatFile
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+
+public:
+    MappedFlatFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile&) = delete;
+    MappedFlatFile& operator=(const MappedFlatFile&) = delete;
+
+    size_t size() const { return m_size; }
+
+    /** Return the mapped bytes [pos, pos + len), or an empty span if they are not all mapped. */
+    Span<const unsigned char> Range(size_t pos, size_t len) const
+    {
+        if (pos > m_size || len > m_size - pos) return {};
+        return Span<const unsigned char>(m_data + pos, len);
+    }
+};
+
+/**
+ * Bounded, least recently used set of read-only memory mappings over the files
+ * of a FlatFileSeq. Only supported on platforms with mmap; elsewhere Get always
+ * returns nullptr and callers fall back to reading through FlatFileSeq::Open.
+ */
+class FlatFileMapCache
+{
+private:
+    const FlatFileSeq m_seq;
+    const size_t m_max_files;
+
+    Mutex m_mutex;
+    //! Mapped files, most recently used first.
+    std::list<std::pair<int, std::shared_ptr<const MappedFlatFile>>> m_lru GUARDED_BY(m_mutex);
+    std::map<int, decltype(m_lru)::iterator> m_files GUARDED_BY(m_mutex);
+
+    std::shared_ptr<const MappedFlatFile> Map(int file) const;
+
+public:
+    /**
+     * @param seq The sequence of files to map.
+     * @param max_files Maximum number of files kept mapped at the same time.
+     */
+    FlatFileMapCache(FlatFileSeq seq, size_t max_files);
+
+    /**
+     * Get a mapping of file `file` which covers at least its first `min_size`
+     * bytes, (re)mapping the file if the cached mapping is missing or too
+     * short. Returns nullptr if the file cannot be mapped or is too small.
+     */
+    std::shared_ptr<const MappedFlatFile> Get(int file, size_t min_size);
+
+    /** Drop the cached mapping of a file, e.g. because it is about to be deleted. */
+    void Erase(int file);
+};
+
 #endif // BITCOIN_FLATFILE_H
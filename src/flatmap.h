@@ -0,0 +1,412 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map with open addressing over a flat slot array and pooled entry storage.
+ *
+ * The table is an array of 8 byte slots, each holding 32 bits of the key's hash
+ * and the index of the entry in a node pool. Lookups probe the slots linearly and
+ * only compare keys of entries whose hash bits match. Entries are constructed in
+ * chunks of pool memory, so inserting does not cost a heap allocation (and the
+ * malloc overhead that comes with it) per entry.
+ *
+ * Entries never move: like with std::unordered_map, references to elements stay
+ * valid until the element is erased (or the map is compacted). Iterators are
+ * invalidated by inserts that rehash the table, but not by erase, which leaves
+ * a tombstone behind. Both `it = m.erase(it)` and `m.erase(it++)` loops are
+ * therefore safe.
+ *
+ * Erasing does not give memory back: erased entries are reused by later inserts.
+ * compact() releases the pool chunks and table slots that are no longer needed.
+ */
+template <typename K, typename T, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    static constexpr uint32_t EMPTY = 0xffffffff;
+    static constexpr uint32_t DELETED = 0xfffffffe;
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+    //! The first pool chunk holds 2^MIN_CHUNK_SHIFT nodes, each following chunk
+    //! twice as many, up to 2^MAX_CHUNK_SHIFT nodes per chunk.
+    static constexpr uint32_t MIN_CHUNK_SHIFT = 4;
+    static constexpr uint32_t MAX_CHUNK_SHIFT = 16;
+    static constexpr uint32_t GEOMETRIC_NODES = (1U << MAX_CHUNK_SHIFT) - (1U << MIN_CHUNK_SHIFT);
+    static constexpr uint32_t GEOMETRIC_CHUNKS = MAX_CHUNK_SHIFT - MIN_CHUNK_SHIFT;
+    static constexpr size_t MIN_SLOTS = 8;
+
+    struct Slot {
+        uint32_t tag;
+        uint32_t index;
+    };
+
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Node;
+
+    //! Power of two number of slots, or none before the first insert.
+    std::vector<Slot> m_slots;
+    std::vector<std::unique_ptr<Node[]>> m_chunks;
+    //! Pool indices of erased entries, reused before fresh ones.
+    std::vector<uint32_t> m_free;
+    uint32_t m_next_index{0};
+    uint32_t m_pool_nodes{0};
+    size_t m_size{0};
+    size_t m_deleted{0};
+    Hash m_hash;
+    KeyEqual m_equal;
+
+    static uint32_t ChunkNodes(size_t chunk)
+    {
+        return chunk < GEOMETRIC_CHUNKS ? 1U << (MIN_CHUNK_SHIFT + chunk) : 1U << MAX_CHUNK_SHIFT;
+    }
+
+    static int HighestBit(uint32_t v)
+    {
+#if defined(__GNUC__)
+        return 31 - __builtin_clz(v);
+#else
+        int bit = 0;
+        while (v >>= 1) ++bit;
+        return bit;
+#endif
+    }
+
+    value_type* NodeAt(uint32_t index) const
+    {
+        size_t chunk;
+        uint32_t offset;
+        if (index < GEOMETRIC_NODES) {
+            const uint32_t v = index + (1U << MIN_CHUNK_SHIFT);
+            const int bit = HighestBit(v);
+            chunk = bit - MIN_CHUNK_SHIFT;
+            offset = v - (1U << bit);
+        } else {
+            chunk = GEOMETRIC_CHUNKS + ((index - GEOMETRIC_NODES) >> MAX_CHUNK_SHIFT);
+            offset = (index - GEOMETRIC_NODES) & ((1U << MAX_CHUNK_SHIFT) - 1);
+        }
+        return reinterpret_cast<value_type*>(&m_chunks[chunk][offset]);
+    }
+
+    uint32_t AllocateNode()
+    {
+        if (!m_free.empty()) {
+            const uint32_t index = m_free.back();
+            m_free.pop_back();
+            return index;
+        }
+        assert(m_next_index < DELETED);
+        const uint32_t index = m_next_index++;
+        // A fresh index past the end of the pool starts a new chunk.
+        if (index == m_pool_nodes) {
+            const uint32_t chunk_nodes = ChunkNodes(m_chunks.size());
+            m_chunks.emplace_back(new Node[chunk_nodes]);
+            m_pool_nodes += chunk_nodes;
+        }
+        return index;
+    }
+
+    static uint32_t Tag(size_t hash)
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(hash) >> (sizeof(size_t) > 4 ? 32 : 0));
+    }
+
+    size_t FindSlot(const K& key, size_t hash) const
+    {
+        if (m_slots.empty()) return NPOS;
+        const size_t mask = m_slots.size() - 1;
+        const uint32_t tag = Tag(hash);
+        for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+            const Slot& slot = m_slots[pos];
+            if (slot.index == EMPTY) return NPOS;
+            if (slot.index != DELETED && slot.tag == tag && m_equal(NodeAt(slot.index)->first, key)) return pos;
+        }
+    }
+
+    //! Place a pool entry in the first free slot of its probe sequence. The table
+    //! must have room for it.
+    size_t PlaceSlot(size_t hash, uint32_t index)
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t pos = hash & mask;
+        while (m_slots[pos].index < DELETED) pos = (pos + 1) & mask;
+        if (m_slots[pos].index == DELETED) --m_deleted;
+        m_slots[pos].tag = Tag(hash);
+        m_slots[pos].index = index;
+        return pos;
+    }
+
+    void Rehash(size_t slot_count)
+    {
+        std::vector<Slot> old_slots(slot_count, Slot{0, EMPTY});
+        old_slots.swap(m_slots);
+        m_deleted = 0;
+        for (const Slot& slot : old_slots) {
+            if (slot.index < DELETED) PlaceSlot(m_hash(NodeAt(slot.index)->first), slot.index);
+        }
+    }
+
+    //! Keep live entries below half and used slots (including tombstones) below
+    //! 7/8 of the table, so probe sequences stay short and always end.
+    void ReserveForInsert()
+    {
+        const size_t slots = m_slots.size();
+        if ((m_size + m_deleted + 1) * 8 <= slots * 7) return;
+        size_t new_slots = slots < MIN_SLOTS ? MIN_SLOTS : slots;
+        while ((m_size + 1) * 2 > new_slots) new_slots *= 2;
+        Rehash(new_slots);
+    }
+
+    size_t InsertNode(size_t hash, uint32_t index)
+    {
+        ReserveForInsert();
+        ++m_size;
+        return PlaceSlot(hash, index);
+    }
+
+    size_t NextLive(size_t pos) const
+    {
+        while (pos < m_slots.size() && m_slots[pos].index >= DELETED) ++pos;
+        return pos;
+    }
+
+    template <bool IsConst>
+    class Iter
+    {
+        friend class flatmap;
+        typedef typename std::conditional<IsConst, const flatmap*, flatmap*>::type map_pointer;
+
+        map_pointer m_map{nullptr};
+        size_t m_pos{0};
+
+        Iter(map_pointer map, size_t pos) : m_map(map), m_pos(pos) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flatmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<IsConst, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<IsConst, const value_type&, value_type&>::type reference;
+
+        Iter() {}
+        template <bool C = IsConst, typename std::enable_if<C, int>::type = 0>
+        Iter(const Iter<false>& other) : m_map(other.m_map), m_pos(other.m_pos) {}
+
+        reference operator*() const { return *m_map->NodeAt(m_map->m_slots[m_pos].index); }
+        pointer operator->() const { return m_map->NodeAt(m_map->m_slots[m_pos].index); }
+        Iter& operator++() { m_pos = m_map->NextLive(m_pos + 1); return *this; }
+        Iter operator++(int) { Iter copy(*this); ++*this; return copy; }
+        friend bool operator==(const Iter& a, const Iter& b) { return a.m_pos == b.m_pos && a.m_map == b.m_map; }
+        friend bool operator!=(const Iter& a, const Iter& b) { return !(a == b); }
+
+        friend class Iter<true>;
+    };
+
+public:
+    typedef Iter<false> iterator;
+    typedef Iter<true> const_iterator;
+
+    flatmap() {}
+    flatmap(const flatmap&) = delete;
+    flatmap& operator=(const flatmap&) = delete;
+    ~flatmap() { clear(); }
+
+    iterator begin() { return iterator(this, NextLive(0)); }
+    const_iterator begin() const { return const_iterator(this, NextLive(0)); }
+    iterator end() { return iterator(this, m_slots.size()); }
+    const_iterator end() const { return const_iterator(this, m_slots.size()); }
+
+    /** Iterator to the first entry in or after slot pos, to walk the map from
+     * an arbitrary point (wrapping around at end()). */
+    iterator begin_at(size_t pos) { return iterator(this, NextLive(std::min(pos, m_slots.size()))); }
+
+    /** Slot of the entry it points to, or the number of slots for end(). */
+    size_t slot_of(const_iterator it) const { return it.m_pos; }
+
+    size_type size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator find(const K& key)
+    {
+        const size_t pos = FindSlot(key, m_hash(key));
+        return pos == NPOS ? end() : iterator(this, pos);
+    }
+
+    const_iterator find(const K& key) const
+    {
+        const size_t pos = FindSlot(key, m_hash(key));
+        return pos == NPOS ? end() : const_iterator(this, pos);
+    }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    /** Piecewise emplace looks the key up first, and only takes a pool node to
+     * construct the entry in when the key is not present yet. */
+    template <typename KeyArg, typename... Args>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t, std::tuple<KeyArg>&& key_args, std::tuple<Args...>&& value_args)
+    {
+        const K& key = std::get<0>(key_args);
+        const size_t hash = m_hash(key);
+        const size_t pos = FindSlot(key, hash);
+        if (pos != NPOS) return std::make_pair(iterator(this, pos), false);
+        const uint32_t index = AllocateNode();
+        try {
+            new (NodeAt(index)) value_type(std::piecewise_construct, std::move(key_args), std::move(value_args));
+        } catch (...) {
+            m_free.push_back(index);
+            throw;
+        }
+        return std::make_pair(iterator(this, InsertNode(hash, index)), true);
+    }
+
+    /** Other forms construct the entry on the stack to find its key, and only
+     * move it into a pool node when the key is not present yet. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type value(std::forward<Args>(args)...);
+        const size_t hash = m_hash(value.first);
+        const size_t pos = FindSlot(value.first, hash);
+        if (pos != NPOS) return std::make_pair(iterator(this, pos), false);
+        const uint32_t index = AllocateNode();
+        try {
+            new (NodeAt(index)) value_type(std::move(value));
+        } catch (...) {
+            m_free.push_back(index);
+            throw;
+        }
+        return std::make_pair(iterator(this, InsertNode(hash, index)), true);
+    }
+
+    T& operator[](const K& key)
+    {
+        const size_t hash = m_hash(key);
+        size_t pos = FindSlot(key, hash);
+        if (pos == NPOS) {
+            const uint32_t index = AllocateNode();
+            try {
+                new (NodeAt(index)) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>());
+            } catch (...) {
+                m_free.push_back(index);
+                throw;
+            }
+            pos = InsertNode(hash, index);
+        }
+        return NodeAt(m_slots[pos].index)->second;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        Slot& slot = m_slots[it.m_pos];
+        NodeAt(slot.index)->~value_type();
+        m_free.push_back(slot.index);
+        slot.index = DELETED;
+        --m_size;
+        ++m_deleted;
+        return iterator(this, NextLive(it.m_pos + 1));
+    }
+
+    iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+    size_type erase(const K& key)
+    {
+        const_iterator it = find(key);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    /** Destroy all entries and release all memory held by the map. */
+    void clear()
+    {
+        for (const Slot& slot : m_slots) {
+            if (slot.index < DELETED) NodeAt(slot.index)->~value_type();
+        }
+        std::vector<Slot>().swap(m_slots);
+        std::vector<std::unique_ptr<Node[]>>().swap(m_chunks);
+        std::vector<uint32_t>().swap(m_free);
+        m_next_index = 0;
+        m_pool_nodes = 0;
+        m_size = 0;
+        m_deleted = 0;
+    }
+
+    /** Move the entries to the front of the pool and release the chunks and the
+     * table slots they no longer need. Invalidates all iterators and references. */
+    void compact()
+    {
+        if (m_size == 0) {
+            clear();
+            return;
+        }
+        // Every free index below m_size is matched by an entry at or past it.
+        std::vector<uint32_t> holes;
+        for (const uint32_t index : m_free) {
+            if (index < m_size) holes.push_back(index);
+        }
+        for (Slot& slot : m_slots) {
+            if (slot.index >= DELETED || slot.index < m_size) continue;
+            const uint32_t index = holes.back();
+            holes.pop_back();
+            value_type* node = NodeAt(slot.index);
+            new (NodeAt(index)) value_type(std::move(*node));
+            node->~value_type();
+            slot.index = index;
+        }
+        assert(holes.empty());
+        std::vector<uint32_t>().swap(m_free);
+        m_next_index = m_size;
+        size_t chunks = 0;
+        m_pool_nodes = 0;
+        while (m_pool_nodes < m_size) m_pool_nodes += ChunkNodes(chunks++);
+        m_chunks.resize(chunks);
+        m_chunks.shrink_to_fit();
+
+        size_t slots = MIN_SLOTS;
+        while ((m_size + 1) * 2 > slots) slots *= 2;
+        Rehash(std::min(slots, m_slots.size()));
+    }
+
+    /** Number of slots in the table, for scaling slot_of() across a compact(). */
+    size_t slot_count() const { return m_slots.size(); }
+
+    /** Bytes of pool memory held by erased entries, which is reused before the pool grows. */
+    size_t reusable_bytes() const { return m_free.size() * sizeof(Node); }
+
+    /** Bytes of pool memory taken by one entry. */
+    static constexpr size_t node_bytes() { return sizeof(Node); }
+
+    /** Call fn(bytes) for every heap allocation owned by the map, for memory usage accounting. */
+    template <typename Fn>
+    void ForEachAllocation(Fn fn) const
+    {
+        fn(m_slots.capacity() * sizeof(Slot));
+        fn(m_chunks.capacity() * sizeof(std::unique_ptr<Node[]>));
+        fn(m_free.capacity() * sizeof(uint32_t));
+        for (size_t chunk = 0; chunk < m_chunks.size(); ++chunk) {
+            fn(ChunkNodes(chunk) * sizeof(Node));
+        }
+    }
+};
+
+#endif // BITCOIN_FLATMAP_H
@@ -87,6 +87,9 @@ protected:
 
     virtual DB& GetDB() const = 0;
 
+    /// The last block in the chain that the index is in sync with.
+    const CBlockIndex* CurrentIndex() const { return m_best_block_index.load(); }
+
     /// Get the name of the index for display in logs.
     virtual const char* GetName() const = 0;
 
@@ -0,0 +1,364 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <crypto/muhash.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the UTXO set statistics after each block. Entries belonging to blocks
+ * on the active chain are indexed by height, and those belonging to blocks that have been
+ * reorganized out of the active chain are indexed by block hash, the same way as the block filter
+ * index.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)].
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ *
+ * Each entry only holds the finalized MuHash3072 digest. The running MuHash3072 of the best block
+ * is stored once under DB_MUHASH, written in the same batch as the best block locator.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+namespace {
+
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count{0};
+    uint64_t bogo_size{0};
+    CAmount total_amount{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(transaction_output_count);
+        READWRITE(bogo_size);
+        READWRITE(total_amount);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+}; // namespace
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+/**
+ * The coinbases of these blocks were overwritten in the UTXO set by the identical coinbases of
+ * blocks 91842 and 91880 (see BIP30), so their outputs never became part of the set.
+ */
+static bool IsBIP30Overwritten(const CBlockIndex* pindex)
+{
+    return (pindex->nHeight == 91722 && pindex->GetBlockHash() == uint256S("0x00000000000271a2dc26e7667f8419f2e15416dc6955e5a6c6cdf3f2574dd08e")) ||
+           (pindex->nHeight == 91812 && pindex->GetBlockHash() == uint256S("0x00000000000af0aed4792b1acee3d966af36cf5def14935db8de83d6f9306f2f"));
+}
+
+static void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin, bool spend)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    TxOutSer(ss, outpoint, coin);
+    Span<const unsigned char> data(reinterpret_cast<const unsigned char*>(ss.data()), ss.size());
+    if (spend) {
+        muhash.Remove(data);
+    } else {
+        muhash.Insert(data);
+    }
+}
+
+static void ApplyCoin(MuHash3072& muhash, DBVal& stats, const COutPoint& outpoint, const Coin& coin, bool spend)
+{
+    ApplyCoinHash(muhash, outpoint, coin, spend);
+    if (spend) {
+        stats.transaction_output_count--;
+        stats.bogo_size -= GetBogoSize(coin);
+        stats.total_amount -= coin.out.nValue;
+    } else {
+        stats.transaction_output_count++;
+        stats.bogo_size += GetBogoSize(coin);
+        stats.total_amount += coin.out.nValue;
+    }
+}
+
+/**
+ * Apply the outputs a block creates and the outputs it spends (or, to take the block back out,
+ * the reverse) to muhash, and to stats if given.
+ */
+static bool ApplyBlock(MuHash3072& muhash, DBVal* stats, const CBlock& block, const CBlockIndex* pindex, bool reverse)
+{
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    const bool bip30_overwritten = IsBIP30Overwritten(pindex);
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+
+        if (!(tx.IsCoinBase() && bip30_overwritten)) {
+            for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                const CTxOut& out = tx.vout[j];
+                // Provably unspendable outputs are never added to the UTXO set, see AddCoins.
+                if (out.scriptPubKey.IsUnspendable()) continue;
+                const COutPoint outpoint(tx.GetHash(), j);
+                const Coin coin(out, pindex->nHeight, tx.IsCoinBase());
+                if (stats) {
+                    ApplyCoin(muhash, *stats, outpoint, coin, reverse);
+                } else {
+                    ApplyCoinHash(muhash, outpoint, coin, reverse);
+                }
+            }
+        }
+
+        // The coinbase has no undo data.
+        if (i == 0) continue;
+
+        const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            if (stats) {
+                ApplyCoin(muhash, *stats, tx.vin[j].prevout, tx_undo.vprevout.at(j), !reverse);
+            } else {
+                ApplyCoinHash(muhash, tx.vin[j].prevout, tx_undo.vprevout.at(j), !reverse);
+            }
+        }
+    }
+    return true;
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+static bool LookUpOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_name = "coinstatsindex";
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* pindex = CurrentIndex();
+    if (!pindex) return true;
+
+    // m_muhash belongs to the committed best block. Should the active chain have moved away from
+    // it while the node was down, the index continues from the fork point, so take the blocks
+    // after it back out.
+    CBlockLocator locator;
+    if (GetDB().ReadBestBlock(locator) && !locator.IsNull()) {
+        const CBlockIndex* committed = WITH_LOCK(cs_main, return LookupBlockIndex(locator.vHave.front()));
+        if (committed && committed != pindex && committed->GetAncestor(pindex->nHeight) == pindex) {
+            CDBBatch batch(*m_db);
+            std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+            if (!CopyHeightIndexToHashIndex(*db_it, batch, m_name, pindex->nHeight + 1, committed->nHeight) ||
+                !m_db->WriteBatch(batch) || !ReverseBlocks(committed, pindex)) {
+                return error("%s: Cannot rewind %s to the active chain", __func__, GetName());
+            }
+        }
+    }
+
+    DBVal entry;
+    if (!LookUpOne(*m_db, pindex, entry)) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    uint256 out;
+    m_muhash.Finalize(out);
+    if (entry.muhash != out) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    batch.Write(DB_MUHASH, m_muhash);
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    DBVal value;
+
+    // The genesis block outputs are not spendable and never enter the UTXO set.
+    if (pindex->nHeight > 0) {
+        std::pair<uint256, DBVal> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+
+        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+        if (read_out.first != expected_block_hash) {
+            return error("%s: previous block stats belong to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        }
+        value = std::move(read_out.second);
+
+        if (!ApplyBlock(m_muhash, &value, block, pindex, /* reverse */ false)) {
+            return false;
+        }
+    }
+    m_muhash.Finalize(value.muhash);
+
+    return m_db->Write(DBHeightKey(pindex->nHeight), std::make_pair(pindex->GetBlockHash(), value));
+}
+
+bool CoinStatsIndex::ReverseBlocks(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    const auto& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ApplyBlock(m_muhash, nullptr, block, pindex, /* reverse */ true)) {
+            return error("%s: Failed to read undo data of block %s",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // Every entry holds the complete statistics for its block, so disconnecting blocks only
+    // requires moving their entries out of the way of the new chain: the next WriteBlock
+    // continues from the entry of new_tip, which is left untouched.
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, m_name, new_tip->nHeight + 1, current_tip->nHeight)) {
+        return false;
+    }
+
+    if (!m_db->WriteBatch(batch)) return false;
+
+    // The running MuHash has to be taken back to new_tip, before BaseIndex::Rewind commits it
+    // along with the new best block.
+    if (!ReverseBlocks(current_tip, new_tip)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal entry;
+    if (!LookUpOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    coins_stats.nHeight = block_index->nHeight;
+    coins_stats.hashBlock = block_index->GetBlockHash();
+    coins_stats.nTransactionOutputs = entry.transaction_output_count;
+    coins_stats.nBogoSize = entry.bogo_size;
+    coins_stats.nTotalAmount = entry.total_amount;
+    coins_stats.hashSerialized = entry.muhash;
+    coins_stats.fFromIndex = true;
+    return true;
+}
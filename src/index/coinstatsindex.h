@@ -0,0 +1,58 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <node/coinstats.h>
+
+/**
+ * CoinStatsIndex maintains statistics about the UTXO set for every block of the
+ * active chain: the number of unspent outputs, their total amount and bogo size,
+ * and the MuHash3072 digest of the set. The entries are derived from the previous
+ * block's entry plus the block and its undo data, so gettxoutsetinfo can be
+ * answered for any height without scanning the chainstate.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    std::string m_name;
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    /// The MuHash3072 of the UTXO set as of the best block of the index. Only the
+    /// finalized digest is stored per block; this running state is stored once,
+    /// committed together with the best block.
+    MuHash3072 m_muhash;
+
+    /// Take the blocks after new_tip up to current_tip back out of m_muhash.
+    bool ReverseBlocks(const CBlockIndex* current_tip, const CBlockIndex* new_tip);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return m_name.c_str(); }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Look up the UTXO set statistics as of the given block. */
+    bool LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
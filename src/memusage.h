@@ -6,7 +6,9 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include <flatmap.h>
 #include <indirectmap.h>
+#include <prevector.h>
 
 #include <stdlib.h>
 
@@ -132,6 +134,24 @@ static inline size_t IncrementalDynamicUsage(const indirectmap<X, Y>& m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X*, Y> >));
 }
 
+// flatmap owns its slot array and a pool of chunks holding the entries. All of
+// it is counted, including the pool memory of erased entries, which the map
+// keeps until it is compacted.
+
+template<typename X, typename Y, typename Z, typename E>
+static inline size_t DynamicUsage(const flatmap<X, Y, Z, E>& m)
+{
+    size_t usage = 0;
+    m.ForEachAllocation([&usage](size_t bytes) { usage += MallocUsage(bytes); });
+    return usage;
+}
+
+template<typename X, typename Y, typename Z, typename E>
+static inline size_t IncrementalDynamicUsage(const flatmap<X, Y, Z, E>& m)
+{
+    return m.node_bytes();
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::unique_ptr<X>& p)
 {
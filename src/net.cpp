@@ -34,6 +34,11 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -78,6 +83,14 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+/** Maximum number of queued buffers handed to one sendmsg() call */
+static const size_t MAX_SEND_IOVECS = 64;
+
+#ifdef USE_EPOLL
+/** Maximum number of socket events fetched by one epoll_wait() call */
+static const int MAX_EPOLL_EVENTS = 256;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -563,7 +576,7 @@ void CNode::copyStats(CNodeStats &stats)
 }
 #undef X
 
-bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
+bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete, CNetMessagePool* pool)
 {
     complete = false;
     int64_t nTimeMicros = GetTimeMicros();
@@ -574,13 +587,19 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
 
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.back().complete()) {
+            if (pool) {
+                pool->NewMessage(vRecvMsg, Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+            } else {
+                vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            }
+        }
 
         CNetMessage& msg = vRecvMsg.back();
 
         // absorb network data
         int handled;
+        const bool header_done = msg.in_data;
         if (!msg.in_data)
             handled = msg.readHeader(pch, nBytes);
         else
@@ -594,6 +613,8 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
             return false;
         }
 
+        if (pool && msg.in_data && !header_done) pool->ReserveData(msg);
+
         pch += handled;
         nBytes -= handled;
 
@@ -614,6 +635,19 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+size_t CNode::PopCompleteMessages(std::list<CNetMessage>& msgs)
+{
+    size_t nSize = 0;
+    auto it(vRecvMsg.begin());
+    for (; it != vRecvMsg.end(); ++it) {
+        if (!it->complete())
+            break;
+        nSize += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    }
+    msgs.splice(msgs.end(), vRecvMsg, vRecvMsg.begin(), it);
+    return nSize;
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -689,6 +723,24 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+void CNetMessage::Reset(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn)
+{
+    hasher.Reset();
+    data_hash.SetNull();
+    in_data = false;
+    hdrbuf.clear();
+    hdrbuf.resize(24);
+    hdrbuf.SetType(nTypeIn);
+    hdrbuf.SetVersion(nVersionIn);
+    hdr = CMessageHeader(pchMessageStartIn);
+    nHdrPos = 0;
+    vRecv.clear();
+    vRecv.SetType(nTypeIn);
+    vRecv.SetVersion(nVersionIn);
+    nDataPos = 0;
+    nTime = 0;
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -697,33 +749,143 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+const std::array<size_t, CNetMessagePool::NUM_SIZE_CLASSES> CNetMessagePool::SIZE_CLASSES{{1024, 64 * 1024, 256 * 1024, MAX_PROTOCOL_MESSAGE_LENGTH}};
+const std::array<size_t, CNetMessagePool::NUM_SIZE_CLASSES> CNetMessagePool::MAX_BUFFERS{{1024, 128, 16, 2}};
+
+void CNetMessagePool::NewMessage(std::list<CNetMessage>& list, const CMessageHeader::MessageStartChars& pchMessageStart, int nType, int nVersion)
+{
+    bool reused = false;
+    {
+        LOCK(m_mutex);
+        if (!m_messages.empty()) {
+            list.splice(list.end(), m_messages, m_messages.begin());
+            reused = true;
+        }
+    }
+    if (reused) {
+        list.back().Reset(pchMessageStart, nType, nVersion);
+    } else {
+        list.push_back(CNetMessage(pchMessageStart, nType, nVersion));
+    }
+}
+
+void CNetMessagePool::ReserveData(CNetMessage& msg)
+{
+    const size_t size = msg.hdr.nMessageSize;
+    if (size == 0) return;
+    size_t size_class = 0;
+    while (size_class + 1 < NUM_SIZE_CLASSES && SIZE_CLASSES[size_class] < size) ++size_class;
+    {
+        LOCK(m_mutex);
+        if (!m_buffers[size_class].empty()) {
+            msg.vRecv.swap(m_buffers[size_class].back());
+            m_buffers[size_class].pop_back();
+            return;
+        }
+    }
+    // Buffers of the largest class are left for readData() to grow as the
+    // data arrives, so a peer cannot make us allocate them just by sending a
+    // header. The others are no larger than what readData() would allocate
+    // right away.
+    if (size_class + 1 < NUM_SIZE_CLASSES) msg.vRecv.reserve(SIZE_CLASSES[size_class]);
+}
+
+void CNetMessagePool::Recycle(std::list<CNetMessage>& msgs)
+{
+    for (CNetMessage& msg : msgs) {
+        CSerializeData buffer;
+        msg.vRecv.swap(buffer);
+        // A buffer goes to the largest class it holds any message of. The
+        // largest class takes all buffers above the one before, which grow
+        // to fit the largest messages over time.
+        if (buffer.capacity() < SIZE_CLASSES[0]) continue;
+        size_t size_class = NUM_SIZE_CLASSES - 1;
+        if (buffer.capacity() <= SIZE_CLASSES[NUM_SIZE_CLASSES - 2]) {
+            while (buffer.capacity() < SIZE_CLASSES[size_class]) --size_class;
+        }
+        buffer.clear();
+        LOCK(m_mutex);
+        if (m_buffers[size_class].size() < MAX_BUFFERS[size_class]) {
+            m_buffers[size_class].push_back(std::move(buffer));
+        }
+    }
+    {
+        LOCK(m_mutex);
+        while (!msgs.empty() && m_messages.size() < MAX_MESSAGES) {
+            m_messages.splice(m_messages.end(), msgs, msgs.begin());
+        }
+    }
+    msgs.clear();
+}
+
+size_t CNetMessagePool::GetMessageCount() const
+{
+    LOCK(m_mutex);
+    return m_messages.size();
+}
+
+size_t CNetMessagePool::GetBufferCount(size_t size_class) const
+{
+    LOCK(m_mutex);
+    return m_buffers[size_class].size();
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+        size_t nToSend = 0;
+        ssize_t nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto &data = **it;
+            assert(data.size() > pnode->nSendOffset);
+            nToSend = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nToSend, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Gather as many queued buffers as possible into one call.
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto jt = it; jt != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++jt, ++nIov) {
+                const auto &data = **jt;
+                assert(data.size() > nOffset);
+                iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nToSend += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers that went out completely.
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nRemaining = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nToSend) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1001,6 +1163,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+#ifdef USE_EPOLL
+    RegisterSocketEvents(pnode);
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1280,10 +1445,146 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+#ifdef USE_EPOLL
+bool CConnman::InitSocketEvents()
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd == -1) {
+        LogPrintf("eventfd failed: %s\n", NetworkErrorString(errno));
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+        return false;
+    }
+
+    // The listening sockets and the wakeup eventfd are level-triggered and
+    // carry no node pointer. They are few, so any event on them simply makes
+    // the socket handler try all of them.
+    std::vector<int> fds{m_wakeup_fd};
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        fds.push_back(hListenSocket.socket);
+    }
+    for (int fd : fds) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(errno));
+            close(m_wakeup_fd);
+            close(m_epoll_fd);
+            m_wakeup_fd = m_epoll_fd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+    if (m_epoll_fd == -1) return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    // Registered once for the lifetime of the socket; closing it removes it
+    // from the epoll set again.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Readiness reported in earlier rounds persists in the nodes until it is
+    // used up, so only block when the previous round had nothing to do.
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, m_socket_events_pending ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(errno));
+        }
+        nEvents = 0;
+    }
+
+    bool fAccept = false;
+    for (int i = 0; i < nEvents; i++) {
+        // Nodes are only deleted by this thread after their socket was closed,
+        // which removes it from the epoll set, so the pointer is still valid.
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (pnode == nullptr) {
+            fAccept = true;
+            continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) pnode->m_sock_readable = true;
+        if (events[i].events & EPOLLOUT) pnode->m_sock_writable = true;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) pnode->m_sock_error = true;
+    }
+
+    if (fAccept) {
+        uint64_t count;
+        // Reset the wakeup counter; fails with EAGAIN if nobody woke us.
+        if (read(m_wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            LogPrintf("eventfd read error %s\n", NetworkErrorString(errno));
+        }
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            recv_set.insert(hListenSocket.socket);
+        }
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Same priorities as GenerateSelectSet(): drain the send queue
+            // before receiving more.
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            if (pnode->m_sock_error) {
+                error_set.insert(pnode->hSocket);
+            }
+            if (select_send) {
+                if (pnode->m_sock_writable) send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (pnode->m_sock_readable && !pnode->fPauseRecv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    m_socket_events_pending = !recv_set.empty() || !send_set.empty() || !error_set.empty();
+}
+#endif
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
-    SocketEvents(recv_set, send_set, error_set);
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        SocketEventsEpoll(recv_set, send_set, error_set);
+    } else
+#endif
+    {
+        SocketEvents(recv_set, send_set, error_set);
+    }
 
     if (interruptNet) return;
 
@@ -1341,20 +1642,15 @@ void CConnman::SocketHandler()
             if (nBytes > 0)
             {
                 bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify, m_msg_pool.get()))
                     pnode->CloseSocketDisconnect();
                 RecordBytesRecv(nBytes);
                 if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                    }
+                    std::list<CNetMessage> msgs;
+                    size_t nSizeAdded = pnode->PopCompleteMessages(msgs);
                     {
                         LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), msgs);
                         pnode->nProcessQueueSize += nSizeAdded;
                         pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                     }
@@ -1373,7 +1669,11 @@ void CConnman::SocketHandler()
             {
                 // error
                 int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                if (nErr == WSAEWOULDBLOCK) {
+                    // Drained; wait for the next edge.
+                    pnode->m_sock_readable = false;
+                }
+                else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                 {
                     if (!pnode->fDisconnect)
                         LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1392,6 +1692,10 @@ void CConnman::SocketHandler()
             if (nBytes) {
                 RecordBytesSent(nBytes);
             }
+            if (!pnode->vSendMsg.empty()) {
+                // The socket buffer is full; wait for the next edge.
+                pnode->m_sock_writable = false;
+            }
         }
 
         InactivityCheck(pnode);
@@ -1413,6 +1717,22 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (m_wakeup_fd == -1) return;
+    const uint64_t one = 1;
+    if (write(m_wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LogPrintf("eventfd write error %s\n", NetworkErrorString(errno));
+    }
+#endif
+}
+
+void CConnman::RecycleMessages(std::list<CNetMessage>& msgs)
+{
+    m_msg_pool->Recycle(msgs);
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
@@ -1970,6 +2290,9 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->m_manual_connection = true;
 
     m_msgproc->InitializeNode(pnode);
+#ifdef USE_EPOLL
+    RegisterSocketEvents(pnode);
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1991,22 +2314,37 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        for (CNode* pnode : vNodesCopy)
+        // With several handler threads, start each round somewhere else so
+        // the threads spread over the peers instead of trailing each other.
+        const size_t nStart = vNodesCopy.empty() ? 0 : m_message_handler_round++ % vNodesCopy.size();
+        for (size_t i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            // Skip peers another thread is busy with. Only messages that
+            // need cs_main wait for each other; the rest of a slow peer's
+            // work no longer holds up everybody else. The wake-up this thread
+            // may have taken could be meant for that peer, so make the thread
+            // holding it look again before it goes to sleep.
+            pnode->m_msgproc_skipped = true;
+            if (pnode->m_msgproc_claimed.exchange(true))
+                continue;
+            pnode->m_msgproc_skipped = false;
+
             // Receive messages
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
             // Send messages
-            {
+            if (!flagInterruptMsgProc) {
                 LOCK(pnode->cs_sendProcessing);
                 m_msgproc->SendMessages(pnode);
             }
 
+            pnode->m_msgproc_claimed = false;
+            if (pnode->m_msgproc_skipped.exchange(false))
+                fMoreWork = true;
             if (flagInterruptMsgProc)
                 return;
         }
@@ -2163,7 +2501,7 @@ void CConnman::SetNetworkActive(bool active)
     uiInterface.NotifyNetworkActiveChanged(fNetworkActive);
 }
 
-CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSeed1(nSeed1In)
+CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSeed1(nSeed1In), m_msg_pool(MakeUnique<CNetMessagePool>())
 {
     SetTryNewOutboundPeer(false);
 
@@ -2279,6 +2617,12 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         fMsgProcWake = false;
     }
 
+#ifdef USE_EPOLL
+    if (m_use_epoll && m_epoll_fd == -1 && !InitSocketEvents()) {
+        LogPrintf("Falling back to %s for socket events\n", SOCKET_EVENTS_LEGACY);
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2302,7 +2646,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < m_message_handler_threads; i++) {
+        threadMessageHandlers.emplace_back(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2335,6 +2681,7 @@ void CConnman::Interrupt()
 
     interruptNet();
     InterruptSocks5(true);
+    WakeSocketHandler();
 
     if (semOutbound) {
         for (int i=0; i<m_max_outbound; i++) {
@@ -2351,8 +2698,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2388,6 +2738,14 @@ void CConnman::Stop()
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
+
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_wakeup_fd);
+        close(m_epoll_fd);
+        m_wakeup_fd = m_epoll_fd = -1;
+    }
+#endif
 }
 
 void CConnman::DeleteNode(CNode* pnode)
@@ -2691,19 +3049,48 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+/** Serialize the header of a message with the given command and payload. */
+static std::vector<unsigned char> MakeMessageHeader(const std::string& command, const std::vector<unsigned char>& data)
 {
-    size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
-
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
+    uint256 hash = Hash(data.data(), data.data() + data.size());
+    CMessageHeader hdr(Params().MessageStart(), command.c_str(), data.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    return serializedHeader;
+}
+
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg) : wire(MakeMessageHeader(msg.command, msg.data)), command(std::move(msg.command))
+{
+    wire.reserve(wire.size() + msg.data.size());
+    wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    size_t nMessageSize = msg.data.size();
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+
+    auto header = std::make_shared<const std::vector<unsigned char>>(MakeMessageHeader(msg.command, msg.data));
+    std::shared_ptr<const std::vector<unsigned char>> payload;
+    if (nMessageSize)
+        payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+    PushSendBuffers(pnode, msg.command, std::move(header), std::move(payload));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsgRef& msg)
+{
+    LogPrint(BCLog::NET, "sending %s (%d bytes, shared) peer=%d\n",  SanitizeString(msg->command.c_str()), msg->wire.size() - CMessageHeader::HEADER_SIZE, pnode->GetId());
+
+    // Alias the wire buffer, keeping the whole message alive while queued.
+    PushSendBuffers(pnode, msg->command, std::shared_ptr<const std::vector<unsigned char>>(msg, &msg->wire), nullptr);
+}
+
+void CConnman::PushSendBuffers(CNode* pnode, const std::string& command, std::shared_ptr<const std::vector<unsigned char>> header, std::shared_ptr<const std::vector<unsigned char>> payload)
+{
+    size_t nTotalSize = header->size() + (payload ? payload->size() : 0);
 
     size_t nBytesSent = 0;
     {
@@ -2711,14 +3098,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         bool optimisticSend(pnode->vSendMsg.empty());
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::move(header));
+        if (payload)
+            pnode->vSendMsg.push_back(std::move(payload));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2743,13 +3130,15 @@ bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
 
 int64_t CConnman::PoissonNextSendInbound(int64_t now, int average_interval_seconds)
 {
-    if (m_next_send_inv_to_incoming < now) {
-        // If this function were called from multiple threads simultaneously
-        // it would possible that both update the next send variable, and return a different result to their caller.
-        // This is not possible in practice as only the net processing thread invokes this function.
-        m_next_send_inv_to_incoming = PoissonNextSend(now, average_interval_seconds);
+    int64_t next = m_next_send_inv_to_incoming;
+    while (next < now) {
+        // Several message handler threads may get here at once. The first one
+        // to update the shared timer decides the next send time for all of
+        // them, so every inbound peer still sees the same schedule.
+        const int64_t candidate = PoissonNextSend(now, average_interval_seconds);
+        if (m_next_send_inv_to_incoming.compare_exchange_weak(next, candidate)) return candidate;
     }
-    return m_next_send_inv_to_incoming;
+    return next;
 }
 
 int64_t PoissonNextSend(int64_t now, int average_interval_seconds)
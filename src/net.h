@@ -25,8 +25,10 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <list>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -39,6 +41,8 @@
 
 class CScheduler;
 class CNode;
+class CNetMessage;
+class CNetMessagePool;
 class BanMan;
 
 /** Default for -whitelistrelay. */
@@ -58,6 +62,18 @@ static const unsigned int MAX_INV_SZ = 50000;
 static const unsigned int MAX_LOCATOR_SZ = 101;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** The -socketevents mode that is always available */
+#ifdef USE_POLL
+static const char* const SOCKET_EVENTS_LEGACY = "poll";
+#else
+static const char* const SOCKET_EVENTS_LEGACY = "select";
+#endif
+/** Default for -socketevents */
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKET_EVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKET_EVENTS = SOCKET_EVENTS_LEGACY;
+#endif
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
 /** Maximum length of the user agent string in `version` message */
@@ -90,6 +106,10 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msghandlerthreads default */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -117,6 +137,21 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * A message in wire format, header included, that is serialized and hashed
+ * once and then queued for any number of peers without being copied.
+ */
+struct CSharedNetMsg
+{
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::vector<unsigned char> wire;
+    std::string command;
+};
+typedef std::shared_ptr<const CSharedNetMsg> CSharedNetMsgRef;
+
+inline CSharedNetMsgRef MakeSharedNetMsg(CSerializedNetMsg&& msg) { return std::make_shared<const CSharedNetMsg>(std::move(msg)); }
+
 
 class NetEventsInterface;
 class CConnman
@@ -154,6 +189,8 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        bool m_use_epoll = false;
+        int m_message_handler_threads = 1;
     };
 
     void Init(const Options& connOptions) {
@@ -172,6 +209,8 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_use_epoll = connOptions.m_use_epoll;
+        m_message_handler_threads = std::max(1, std::min(connOptions.m_message_handler_threads, MAX_MESSAGE_HANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -209,6 +248,7 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsgRef& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -325,6 +365,12 @@ public:
 
     void WakeMessageHandler();
 
+    /** Interrupt the socket handler's wait for socket events (epoll backend only). */
+    void WakeSocketHandler();
+
+    /** Give processed messages back for their memory to be reused by later ones. */
+    void RecycleMessages(std::list<CNetMessage>& msgs);
+
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
         Variable intervals will result in privacy decrease.
@@ -355,6 +401,11 @@ private:
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_EPOLL
+    bool InitSocketEvents();
+    void RegisterSocketEvents(CNode* pnode);
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -374,6 +425,9 @@ private:
 
     NodeId GetNewNodeId();
 
+    //! Queue the buffers of a message (payload may be null) and try to send them right away.
+    void PushSendBuffers(CNode* pnode, const std::string& command, std::shared_ptr<const std::vector<unsigned char>> header, std::shared_ptr<const std::vector<unsigned char>> payload);
+
     size_t SocketSendData(CNode *pnode) const;
     void DumpAddresses();
 
@@ -457,6 +511,30 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
+    /** Use the epoll backend for socket events, if it could be set up. */
+    bool m_use_epoll{false};
+    /** epoll instance that all sockets stay registered with (epoll backend only). */
+    int m_epoll_fd{-1};
+    /** eventfd registered with m_epoll_fd to interrupt epoll_wait(). */
+    int m_wakeup_fd{-1};
+    /** Whether the previous round had sockets to service, so more may be pending. */
+    bool m_socket_events_pending{false};
+
+    /**
+     * Number of threads running ThreadMessageHandler(). They all handle every
+     * kind of message. There is no separate thread for the messages that need
+     * cs_main: most handlers take it at some point, often only for part of their
+     * work, so they cannot be told apart by command, and a peer's messages must
+     * stay in order anyway, so a peer waiting for such a thread would be held up
+     * just the same. The threads only wait for each other on cs_main itself.
+     */
+    int m_message_handler_threads{1};
+    /** Where the next round of a message handler thread starts in vNodes. */
+    std::atomic<size_t> m_message_handler_round{0};
+
+    /** Memory of received messages, reused across all peers. */
+    std::unique_ptr<CNetMessagePool> m_msg_pool;
+
     /** flag for waking the message processor. */
     bool fMsgProcWake;
 
@@ -470,7 +548,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -650,10 +728,48 @@ public:
         vRecv.SetVersion(nVersionIn);
     }
 
+    /** Prepare for receiving another message, keeping the memory already held. */
+    void Reset(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn);
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
 };
 
+/**
+ * Pool of received messages and their data buffers, so that receiving does
+ * no allocations once warmed up. Processed messages are taken back whole
+ * (including their list node); their buffers are kept apart, in size classes
+ * matching the common protocol messages, and handed to new messages once
+ * their header tells how large they are.
+ */
+class CNetMessagePool
+{
+public:
+    static constexpr size_t NUM_SIZE_CLASSES = 4;
+    /** Buffer size of each class: control messages and small invs; transactions,
+     *  addrs and compact blocks; headers and blocktxns; full blocks. */
+    static const std::array<size_t, NUM_SIZE_CLASSES> SIZE_CLASSES;
+    /** Maximum number of spare buffers kept in each class. */
+    static const std::array<size_t, NUM_SIZE_CLASSES> MAX_BUFFERS;
+    /** Maximum number of spare messages kept. */
+    static constexpr size_t MAX_MESSAGES = 1024;
+
+    /** Append a message ready to receive to list, reusing a spare one if any. */
+    void NewMessage(std::list<CNetMessage>& list, const CMessageHeader::MessageStartChars& pchMessageStart, int nType, int nVersion);
+    /** Once the header of msg was read, give it a buffer that fits its data. */
+    void ReserveData(CNetMessage& msg);
+    /** Take back the messages in msgs, leaving it empty. */
+    void Recycle(std::list<CNetMessage>& msgs);
+
+    size_t GetMessageCount() const;
+    size_t GetBufferCount(size_t size_class) const;
+
+private:
+    mutable Mutex m_mutex;
+    std::list<CNetMessage> m_messages GUARDED_BY(m_mutex);
+    std::array<std::vector<CSerializeData>, NUM_SIZE_CLASSES> m_buffers GUARDED_BY(m_mutex);
+};
+
 
 /** Information about a peer */
 class CNode
@@ -666,7 +782,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg GUARDED_BY(cs_vSend);
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -677,6 +793,13 @@ public:
 
     CCriticalSection cs_sendProcessing;
 
+    // Set while a message handler thread processes this peer. Each peer is
+    // handled by one thread at a time, which keeps its messages in order.
+    std::atomic_bool m_msgproc_claimed{false};
+    // Set by a message handler thread that skipped this peer because it was
+    // claimed, so that the thread holding it goes over the peers once more.
+    std::atomic_bool m_msgproc_skipped{false};
+
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes GUARDED_BY(cs_vRecv){0};
     std::atomic<int> nRecvVersion{INIT_PROTO_VERSION};
@@ -720,6 +843,13 @@ public:
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
 
+    // Readiness of the socket as last reported by the epoll backend, which
+    // is edge-triggered: it stays set until a recv() or send() would block.
+    // Only accessed by the socket handler thread.
+    bool m_sock_readable{false};
+    bool m_sock_writable{false};
+    bool m_sock_error{false};
+
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
@@ -729,8 +859,12 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Other peers' message handler threads push addresses to relay to this
+    // peer, so these are guarded by their own lock rather than by the thread
+    // processing this peer.
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addr_send);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_addr_send);
+    CCriticalSection cs_addr_send;
     bool fGetAddr{false};
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
     int64_t nNextLocalAddrSend GUARDED_BY(cs_sendProcessing){0};
@@ -853,7 +987,9 @@ public:
         return nRefCount;
     }
 
-    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete, CNetMessagePool* pool = nullptr);
+    /** Move the messages received in full to msgs, returning their total size. */
+    size_t PopCompleteMessages(std::list<CNetMessage>& msgs);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -885,11 +1021,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addr_send);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_addr_send);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -32,6 +32,7 @@
 
 #include <memory>
 #include <typeinfo>
+#include <unordered_set>
 
 #if defined(NDEBUG)
 # error "Bitcoin cannot be compiled without assertions."
@@ -108,6 +109,12 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** How long (in microseconds) transactions stay in the shared announcement batch
+ *  once added. Peers with older ones still queued add them back. */
+static constexpr int64_t TX_ANNOUNCEMENT_BATCH_EXPIRY = 2 * 60 * 1000000;
+/** Minimum time (in microseconds) between rebuilds of the shared announcement batch,
+ *  the average trickle delay of outbound peers. */
+static constexpr int64_t TX_ANNOUNCEMENT_BATCH_INTERVAL = INVENTORY_BROADCAST_INTERVAL * 1000000LL / 2;
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -1151,6 +1158,31 @@ static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+// The block and compact block messages for the above, serialized on first use with
+// (index 0) or without (index 1) witnesses, and shared by all peers they are sent to
+static CSharedNetMsgRef most_recent_block_msgs[2] GUARDED_BY(cs_most_recent_block);
+static CSharedNetMsgRef most_recent_compact_block_msgs[2] GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Get the shared BLOCK or CMPCTBLOCK message for the most recent block,
+ * serialized with nSendFlags. Returns nullptr if the most recent block is not
+ * the one with the given hash (anymore).
+ */
+static CSharedNetMsgRef MostRecentBlockMsg(const uint256& hash, bool compact, int nSendFlags) EXCLUSIVE_LOCKS_REQUIRED(cs_most_recent_block)
+{
+    if (!most_recent_block || most_recent_block_hash != hash) return nullptr;
+    const int index = (nSendFlags & SERIALIZE_TRANSACTION_NO_WITNESS) ? 1 : 0;
+    CSharedNetMsgRef& msg = compact ? most_recent_compact_block_msgs[index] : most_recent_block_msgs[index];
+    if (!msg) {
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        if (compact) {
+            msg = MakeSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+        } else {
+            msg = MakeSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *most_recent_block));
+        }
+    }
+    return msg;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1158,7 +1190,6 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
-    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
 
@@ -1169,6 +1200,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
     bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
     uint256 hashBlock(pblock->GetHash());
+    CSharedNetMsgRef msg_cmpctblock;
 
     {
         LOCK(cs_most_recent_block);
@@ -1176,12 +1208,17 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        for (int i = 0; i < 2; i++) {
+            most_recent_block_msgs[i].reset();
+            most_recent_compact_block_msgs[i].reset();
+        }
+        // Serialized once for all the peers it is announced to below.
+        msg_cmpctblock = MostRecentBlockMsg(hashBlock, /* compact */ true, /* nSendFlags */ 0);
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    connman->ForEachNode([this, &msg_cmpctblock, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -1193,7 +1230,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msg_cmpctblock);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1446,10 +1483,20 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
             pblock = pblockRead;
         }
         if (pblock) {
-            if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_WITNESS_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+                const int nSendFlags = inv.type == MSG_BLOCK ? SERIALIZE_TRANSACTION_NO_WITNESS : 0;
+                // Many peers are likely to ask for the most recent block, so
+                // serialize it only once for all of them.
+                CSharedNetMsgRef msg;
+                if (pblock == a_recent_block) {
+                    msg = WITH_LOCK(cs_most_recent_block, return MostRecentBlockMsg(pblock->GetHash(), /* compact */ false, nSendFlags));
+                }
+                if (msg) {
+                    connman->PushMessage(pfrom, msg);
+                } else {
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                }
+            }
             else if (inv.type == MSG_FILTERED_BLOCK)
             {
                 bool sendMerkleBlock = false;
@@ -1485,7 +1532,14 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                 bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
                 int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
                 if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
+                    const bool fUseRecent = (fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash();
+                    CSharedNetMsgRef msg;
+                    if (fUseRecent) {
+                        msg = WITH_LOCK(cs_most_recent_block, return MostRecentBlockMsg(pindex->GetBlockHash(), /* compact */ true, nSendFlags));
+                    }
+                    if (msg) {
+                        connman->PushMessage(pfrom, msg);
+                    } else if (fUseRecent) {
                         connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                     } else {
                         CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
@@ -3025,7 +3079,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        WITH_LOCK(pfrom->cs_addr_send, pfrom->vAddrToSend.clear());
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -3312,6 +3366,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    // Hand the message back for reuse once done with it, however that happens
+    struct RecycleOnExit {
+        CConnman* connman;
+        std::list<CNetMessage>& msgs;
+        ~RecycleOnExit() { connman->RecycleMessages(msgs); }
+    } recycle_on_exit{connman, msgs};
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -3319,7 +3379,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        const bool was_paused = pfrom->fPauseRecv;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+        // The socket may have stayed readable all along, which the socket
+        // handler is not notified about again.
+        if (was_paused && !pfrom->fPauseRecv) connman->WakeSocketHandler();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
@@ -3517,20 +3581,95 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
 }
 
 namespace {
-class CompareInvMempoolOrder
+/**
+ * Transactions being announced to peers, ranked once for all of them rather
+ * than by each peer on its own: ranks follow CompareDepthAndScore, and the
+ * mempool membership and feerates are those the mempool had when the batch
+ * was built.
+ */
+struct TxAnnouncementBatch
 {
-    CTxMemPool *mp;
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
+    struct Entry
     {
-        mp = _mempool;
+        //! The transaction, or null if it was not in the mempool
+        CTransactionRef tx;
+        CAmount fee_per_k;
+        size_t rank;
+        int64_t time_added;
+    };
+    std::unordered_map<uint256, Entry, SaltedTxidHasher> entries;
+    //! When the batch was built, in microseconds
+    int64_t time_built;
+};
+
+Mutex g_cs_tx_announcements;
+std::shared_ptr<const TxAnnouncementBatch> g_tx_announcements GUARDED_BY(g_cs_tx_announcements);
+//! Transactions that peers have queued but that are not in g_tx_announcements
+std::unordered_set<uint256, SaltedTxidHasher> g_tx_announcements_wanted GUARDED_BY(g_cs_tx_announcements);
+
+/**
+ * Get the shared batch. It is rebuilt, with a single pass over the mempool,
+ * at most once every TX_ANNOUNCEMENT_BATCH_INTERVAL; candidates that are not
+ * in it until then are noted and stay queued for the peer, and are added at
+ * the next rebuild. nNow is the (mockable) time in microseconds.
+ */
+std::shared_ptr<const TxAnnouncementBatch> GetTxAnnouncementBatch(const std::set<uint256>& candidates, int64_t nNow)
+{
+    LOCK(g_cs_tx_announcements);
+    for (const uint256& hash : candidates) {
+        // Expired entries are left out when the batch is rebuilt, so add
+        // those as if they were new.
+        if (g_tx_announcements) {
+            const auto it = g_tx_announcements->entries.find(hash);
+            if (it != g_tx_announcements->entries.end() && it->second.time_added >= nNow - TX_ANNOUNCEMENT_BATCH_EXPIRY) continue;
+        }
+        g_tx_announcements_wanted.insert(hash);
+    }
+    if (g_tx_announcements && nNow >= g_tx_announcements->time_built && nNow < g_tx_announcements->time_built + TX_ANNOUNCEMENT_BATCH_INTERVAL) {
+        return g_tx_announcements;
+    }
+
+    // Rank everything in the batch again, as ranks are only comparable
+    // within a single pass.
+    std::vector<uint256> hashes;
+    std::unordered_map<uint256, int64_t, SaltedTxidHasher> time_added;
+    for (const uint256& hash : g_tx_announcements_wanted) {
+        hashes.push_back(hash);
+        time_added.emplace(hash, nNow);
     }
+    g_tx_announcements_wanted.clear();
+    if (g_tx_announcements) {
+        for (const auto& entry : g_tx_announcements->entries) {
+            if (entry.second.time_added < nNow - TX_ANNOUNCEMENT_BATCH_EXPIRY) continue;
+            if (!time_added.emplace(entry.first, entry.second.time_added).second) continue;
+            hashes.push_back(entry.first);
+        }
+    }
+    auto batch = std::make_shared<TxAnnouncementBatch>();
+    batch->time_built = nNow;
+    batch->entries.reserve(hashes.size());
+    size_t rank = 0;
+    for (auto& txinfo : mempool.infoSorted(hashes)) {
+        const uint256& hash = txinfo.tx->GetHash();
+        batch->entries.emplace(hash, TxAnnouncementBatch::Entry{std::move(txinfo.tx), txinfo.feeRate.GetFeePerK(), rank++, time_added[hash]});
+    }
+    for (const uint256& hash : hashes) {
+        batch->entries.emplace(hash, TxAnnouncementBatch::Entry{nullptr, 0, rank, time_added[hash]});
+    }
+    g_tx_announcements = std::move(batch);
+    return g_tx_announcements;
+}
+
+typedef std::pair<const TxAnnouncementBatch::Entry*, std::set<uint256>::iterator> TxAnnouncement;
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+class CompareInvMempoolOrder
+{
+public:
+    bool operator()(const TxAnnouncement& a, const TxAnnouncement& b) const
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+         * fewest ancestors/highest fee (the lowest rank) to sort later. */
+        return a.first->rank > b.first->rank;
     }
 };
 }
@@ -3594,6 +3733,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         //
         if (pto->IsAddrRelayPeer() && pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addr_send);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3723,7 +3863,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
                             if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                                connman->PushMessage(pto, MostRecentBlockMsg(most_recent_block_hash, /* compact */ true, nSendFlags));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -3856,10 +3996,23 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 // Determine transactions to relay
                 if (fSendTrickle) {
                     // Produce a vector with all candidates for sending
-                    std::vector<std::set<uint256>::iterator> vInvTx;
+                    const auto batch = GetTxAnnouncementBatch(pto->m_tx_relay->setInventoryTxToSend, GetTime<std::chrono::microseconds>().count());
+                    std::vector<TxAnnouncement> vInvTx;
                     vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
-                    for (std::set<uint256>::iterator it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end(); it++) {
-                        vInvTx.push_back(it);
+                    for (std::set<uint256>::iterator it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end();) {
+                        const auto entry = batch->entries.find(*it);
+                        // Queued after the batch was built, keep it for a
+                        // later trickle.
+                        if (entry == batch->entries.end()) {
+                            ++it;
+                            continue;
+                        }
+                        // Not in the mempool anymore? don't bother sending it.
+                        if (!entry->second.tx) {
+                            it = pto->m_tx_relay->setInventoryTxToSend.erase(it);
+                            continue;
+                        }
+                        vInvTx.emplace_back(&entry->second, it++);
                     }
                     CAmount filterrate = 0;
                     {
@@ -3868,7 +4021,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     }
                     // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                     // A heap is used so that not all items need sorting if only a few are being sent.
-                    CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
+                    CompareInvMempoolOrder compareInvMempoolOrder;
                     std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
@@ -3877,7 +4030,8 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                         // Fetch the top element from the heap
                         std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                        std::set<uint256>::iterator it = vInvTx.back();
+                        const TxAnnouncementBatch::Entry& entry = *vInvTx.back().first;
+                        std::set<uint256>::iterator it = vInvTx.back().second;
                         vInvTx.pop_back();
                         uint256 hash = *it;
                         // Remove it from the to-be-sent set
@@ -3886,15 +4040,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         if (pto->m_tx_relay->filterInventoryKnown.contains(hash)) {
                             continue;
                         }
-                        // Not in the mempool anymore? don't bother sending it.
-                        auto txinfo = mempool.info(hash);
-                        if (!txinfo.tx) {
-                            continue;
-                        }
-                        if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
+                        if (filterrate && entry.fee_per_k < filterrate) {
                             continue;
                         }
-                        if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                        if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*entry.tx)) continue;
                         // Send
                         vInv.push_back(CInv(MSG_TX, hash));
                         nRelayedTransactions++;
@@ -3906,7 +4055,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                                 vRelayExpiration.pop_front();
                             }
 
-                            auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                            auto ret = mapRelay.insert(std::make_pair(hash, entry.tx));
                             if (ret.second) {
                                 vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                             }
@@ -9,48 +9,81 @@
 #include <amount.h>
 #include <coins.h>
 #include <chain.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <serialize.h>
+#include <txdb.h>
 #include <validation.h>
 #include <uint256.h>
 #include <util/system.h>
 
+#include <future>
 #include <map>
 
 #include <boost/thread.hpp>
 
+//! Maximum number of key space shards scanned in parallel for order independent hashes
+static constexpr int MAX_UTXO_STATS_SHARDS = 16;
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+void TxOutSer(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+}
+
+uint64_t GetBogoSize(const Coin& coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+}
+
+static void ApplyHash(CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
-    assert(!outputs.empty());
     ss << hash;
     ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
     for (const auto& output : outputs) {
         ss << VARINT(output.first + 1);
         ss << output.second.out.scriptPubKey;
         ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
     }
     ss << VARINT(0u);
 }
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static void ApplyHash(MuHash3072& muhash, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
+    for (const auto& output : outputs) {
+        CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+        TxOutSer(ss, COutPoint(hash, output.first), output.second);
+        muhash.Insert(Span<const unsigned char>(reinterpret_cast<const unsigned char*>(ss.data()), ss.size()));
+    }
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
+static void ApplyHash(std::nullptr_t, const uint256& hash, const std::map<uint32_t, Coin>& outputs) {}
+
+static void CombineHash(MuHash3072& muhash, const MuHash3072& shard) { muhash *= shard; }
+static void CombineHash(std::nullptr_t, std::nullptr_t) {}
+
+template <typename T>
+static void ApplyStats(CCoinsStats& stats, T& hash_obj, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ApplyHash(hash_obj, hash, outputs);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += GetBogoSize(output.second);
     }
-    ss << stats.hashBlock;
+}
+
+/**
+ * Accumulate the coins the cursor points at into stats and hash_obj, stopping
+ * at the first txid whose leading key byte is end_byte or more (256 = no limit).
+ */
+template <typename T>
+static bool ScanCoins(CCoinsViewCursor* pcursor, CCoinsStats& stats, T& hash_obj, int end_byte)
+{
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
@@ -58,8 +91,11 @@ bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         COutPoint key;
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (*key.hash.begin() >= end_byte) {
+                break;
+            }
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(stats, hash_obj, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -70,9 +106,100 @@ bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(stats, hash_obj, prevkey, outputs);
+    }
+    return true;
+}
+
+/**
+ * Scan the coins in n_shards ranges of the key space concurrently, each with
+ * its own cursor, and combine the results. Only valid for hashes that do not
+ * depend on the order in which coins are visited.
+ */
+template <typename T>
+static bool ScanCoinsSharded(CCoinsViewDB* view, CCoinsViewAsyncFlush& flusher, CCoinsStats& stats, T& hash_obj, int n_shards)
+{
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    {
+        // No chainstate flush can start while cs_main is held, but the last
+        // one may still be committed in the background. Wait for it, so that
+        // all cursors see the same complete state of the database.
+        LOCK(cs_main);
+        if (!flusher.WaitForFlush()) return false;
+        for (int i = 0; i < n_shards; ++i) {
+            uint256 start;
+            *start.begin() = 256 * i / n_shards;
+            cursors.emplace_back(view->Cursor(start));
+            assert(cursors.back());
+        }
+        stats.hashBlock = cursors.front()->GetBestBlock();
+        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
+    }
+
+    std::vector<CCoinsStats> shard_stats(n_shards);
+    std::vector<T> shard_hashes(n_shards);
+    std::vector<std::future<bool>> results;
+    for (int i = 0; i < n_shards; ++i) {
+        const int end_byte = 256 * (i + 1) / n_shards;
+        results.emplace_back(std::async(std::launch::async, [&, i, end_byte] {
+            return ScanCoins(cursors[i].get(), shard_stats[i], shard_hashes[i], end_byte);
+        }));
+    }
+
+    bool ok = true;
+    for (int i = 0; i < n_shards; ++i) {
+        // get() rethrows any exception raised while scanning the shard
+        ok &= results[i].get();
+        stats.nTransactions += shard_stats[i].nTransactions;
+        stats.nTransactionOutputs += shard_stats[i].nTransactionOutputs;
+        stats.nBogoSize += shard_stats[i].nBogoSize;
+        stats.nTotalAmount += shard_stats[i].nTotalAmount;
+        CombineHash(hash_obj, shard_hashes[i]);
     }
-    stats.hashSerialized = ss.GetHash();
+    return ok;
+}
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsViewAsyncFlush& flusher, CCoinsStats& stats, CoinStatsHashType hash_type)
+{
+    switch (hash_type) {
+    case CoinStatsHashType::HASH_SERIALIZED: {
+        std::unique_ptr<CCoinsViewCursor> pcursor;
+        {
+            // See ScanCoinsSharded.
+            LOCK(cs_main);
+            if (!flusher.WaitForFlush()) return false;
+            pcursor.reset(view->Cursor());
+            assert(pcursor);
+            stats.hashBlock = pcursor->GetBestBlock();
+            stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
+        }
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        if (!ScanCoins(pcursor.get(), stats, ss, 256)) {
+            return false;
+        }
+        stats.hashSerialized = ss.GetHash();
+        break;
+    }
+    case CoinStatsHashType::MUHASH: {
+        MuHash3072 muhash;
+        if (!ScanCoinsSharded(view, flusher, stats, muhash, std::min(GetNumCores(), MAX_UTXO_STATS_SHARDS))) {
+            return false;
+        }
+        muhash.Finalize(stats.hashSerialized);
+        break;
+    }
+    case CoinStatsHashType::NONE: {
+        std::nullptr_t no_hash;
+        if (!ScanCoinsSharded(view, flusher, stats, no_hash, std::min(GetNumCores(), MAX_UTXO_STATS_SHARDS))) {
+            return false;
+        }
+        break;
+    }
+    }
+
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
@@ -12,7 +12,20 @@
 
 #include <cstdint>
 
-class CCoinsView;
+class CCoinsViewAsyncFlush;
+class CCoinsViewDB;
+class CDataStream;
+class COutPoint;
+class Coin;
+
+enum class CoinStatsHashType {
+    //! Order dependent hash of the serialized set (hash_serialized_2), computed on a single thread
+    HASH_SERIALIZED,
+    //! Order independent MuHash3072 of the set, computed over key space shards in parallel
+    MUHASH,
+    //! Only compute the counts and totals, in parallel
+    NONE,
+};
 
 struct CCoinsStats
 {
@@ -24,11 +37,21 @@ struct CCoinsStats
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    //! Whether the stats were looked up in the coinstats index; nTransactions and nDiskSize are then not set
+    bool fFromIndex;
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0), fFromIndex(false) {}
 };
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+//! Serialize a coin the way it is committed to by the MuHash of the UTXO set
+void TxOutSer(CDataStream& ss, const COutPoint& outpoint, const Coin& coin);
+
+//! Size of a coin as counted in CCoinsStats::nBogoSize
+uint64_t GetBogoSize(const Coin& coin);
+
+//! Calculate statistics about the unspent transaction output set. flusher is
+//! the view committing flushed coins to view in the background; the scan waits
+//! for its batch in flight, if any, so that it sees the state of a single block.
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsViewAsyncFlush& flusher, CCoinsStats& stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED);
 
 #endif // BITCOIN_NODE_COINSTATS_H
@@ -101,18 +101,112 @@ unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexLast, const CBlock
     return LwmaCalculateNextWorkRequired(pindexLast, params);
 }
 
+/** Solvetime of a block as seen by LWMA, optionally capped at 6 * T. */
+static int64_t LwmaSolvetime(const CBlockIndex* block, const Consensus::Params& params)
+{
+    int64_t solvetime = block->GetBlockTime() - block->pprev->GetBlockTime();
+    if (params.bZawyLwmaSolvetimeLimitation && solvetime > 6 * params.nPowTargetSpacing) {
+        solvetime = 6 * params.nPowTargetSpacing;
+    }
+    return solvetime;
+}
+
+/** Contribution of a block to the LWMA target sum, pre-divided by (k N^2). */
+static arith_uint256 LwmaTargetTerm(const CBlockIndex* block, const Consensus::Params& params)
+{
+    const int N = params.nZawyLwmaAveragingWindow;
+    const int k = params.nZawyLwmaAdjustedWeight;
+    arith_uint256 target;
+    target.SetCompact(block->nBits);
+    return target / (k * N * N);
+}
+
+static bool LwmaWindowMatches(const LwmaWindow& window, const Consensus::Params& params)
+{
+    return window.N == params.nZawyLwmaAveragingWindow &&
+           window.k == params.nZawyLwmaAdjustedWeight &&
+           window.limit_st == params.bZawyLwmaSolvetimeLimitation;
+}
+
+static unsigned int LwmaNextTarget(const arith_uint256& sum_target, int t, const Consensus::Params& params)
+{
+    const int N = params.nZawyLwmaAveragingWindow;
+    const int k = params.nZawyLwmaAdjustedWeight;
+    const int dnorm = params.nZawyLwmaMinDenominator;
+
+    // Keep t reasonable in case strange solvetimes occurred.
+    if (t < N * k / dnorm) {
+        t = N * k / dnorm;
+    }
+
+    const arith_uint256 pow_limit = UintToArith256(params.powLimit);
+    arith_uint256 next_target = t * sum_target;
+    if (next_target > pow_limit) {
+        next_target = pow_limit;
+    }
+
+    return next_target.GetCompact();
+}
+
+const LwmaWindow& GetLwmaWindow(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    if (pindexLast->lwmaWindow && LwmaWindowMatches(*pindexLast->lwmaWindow, params)) {
+        return *pindexLast->lwmaWindow;
+    }
+
+    const int N = params.nZawyLwmaAveragingWindow;
+    assert(pindexLast->nHeight >= N);
+
+    LwmaWindow window;
+    window.N = params.nZawyLwmaAveragingWindow;
+    window.k = params.nZawyLwmaAdjustedWeight;
+    window.limit_st = params.bZawyLwmaSolvetimeLimitation;
+
+    const CBlockIndex* pindexPrev = pindexLast->pprev;
+    if (pindexPrev->lwmaWindow && LwmaWindowMatches(*pindexPrev->lwmaWindow, params)) {
+        // Slide the parent's window forward by one block: every remaining
+        // solvetime loses one unit of weight, the oldest block drops out and
+        // pindexLast enters with weight N.
+        const LwmaWindow& prev = *pindexPrev->lwmaWindow;
+        const CBlockIndex* pindexOut = pindexLast->GetAncestor(pindexLast->nHeight - N);
+        const int64_t solvetime_in = LwmaSolvetime(pindexLast, params);
+        window.weighted_solvetime = prev.weighted_solvetime - prev.solvetime + N * solvetime_in;
+        window.solvetime = prev.solvetime - LwmaSolvetime(pindexOut, params) + solvetime_in;
+        window.sum_target = prev.sum_target - LwmaTargetTerm(pindexOut, params) + LwmaTargetTerm(pindexLast, params);
+    } else {
+        const CBlockIndex* block = pindexLast;
+        for (int j = N; j > 0; j--, block = block->pprev) {
+            const int64_t solvetime = LwmaSolvetime(block, params);
+            window.weighted_solvetime += solvetime * j;
+            window.solvetime += solvetime;
+            window.sum_target += LwmaTargetTerm(block, params);
+        }
+    }
+
+    pindexLast->lwmaWindow = std::make_shared<const LwmaWindow>(window);
+    return *pindexLast->lwmaWindow;
+}
+
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
     if (params.fPowNoRetargeting) {
         return pindexLast->nBits;
     }
 
+    assert(pindexLast->nHeight + 1 > params.nZawyLwmaAveragingWindow);
+    const LwmaWindow& window = GetLwmaWindow(pindexLast, params);
+    // Truncate like the original int accumulator did.
+    return LwmaNextTarget(window.sum_target, static_cast<int>(window.weighted_solvetime), params);
+}
+
+unsigned int LwmaCalculateNextWorkRequiredUncached(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    if (params.fPowNoRetargeting) {
+        return pindexLast->nBits;
+    }
+
     const int height = pindexLast->nHeight + 1;
-    const int64_t T = params.nPowTargetSpacing;
     const int N = params.nZawyLwmaAveragingWindow;
-    const int k = params.nZawyLwmaAdjustedWeight;
-    const int dnorm = params.nZawyLwmaMinDenominator;
-    const bool limit_st = params.bZawyLwmaSolvetimeLimitation;
     assert(height > N);
 
     arith_uint256 sum_target;
@@ -121,35 +215,16 @@ unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const
     // Loop through N most recent blocks.
     for (int i = height - N; i < height; i++) {
         const CBlockIndex* block = pindexLast->GetAncestor(i);
-        const CBlockIndex* block_Prev = block->GetAncestor(i - 1);
-        int64_t solvetime = block->GetBlockTime() - block_Prev->GetBlockTime();
-
-        if (limit_st && solvetime > 6 * T) {
-            solvetime = 6 * T;
-        }
-
         j++;
-        t += solvetime * j;  // Weighted solvetime sum.
+        t += LwmaSolvetime(block, params) * j;  // Weighted solvetime sum.
 
         // Target sum divided by a factor, (k N^2).
         // The factor is a part of the final equation. However we divide sum_target here to avoid
         // potential overflow.
-        arith_uint256 target;
-        target.SetCompact(block->nBits);
-        sum_target += target / (k * N * N);
-    }
-    // Keep t reasonable in case strange solvetimes occurred.
-    if (t < N * k / dnorm) {
-        t = N * k / dnorm;
+        sum_target += LwmaTargetTerm(block, params);
     }
 
-    const arith_uint256 pow_limit = UintToArith256(params.powLimit);
-    arith_uint256 next_target = t * sum_target;
-    if (next_target > pow_limit) {
-        next_target = pow_limit;
-    }
-
-    return next_target.GetCompact();
+    return LwmaNextTarget(sum_target, t, params);
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
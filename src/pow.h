@@ -7,6 +7,7 @@
 #ifndef BITCOIN_POW_H
 #define BITCOIN_POW_H
 
+#include <arith_uint256.h>
 #include <consensus/params.h>
 
 #include <stdint.h>
@@ -26,6 +27,30 @@ unsigned int BitcoinCalculateNextWorkRequired(const CBlockIndex* pindexLast, int
 /** Zawy's LWMA - next generation algorithm */
 unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params);
+/** Same as LwmaCalculateNextWorkRequired, but walks the whole window instead of using the cached LwmaWindow. */
+unsigned int LwmaCalculateNextWorkRequiredUncached(const CBlockIndex* pindexLast, const Consensus::Params& params);
+
+/**
+ * LWMA accumulators over the nZawyLwmaAveragingWindow blocks ending at (and
+ * including) a block index entry. Cached in CBlockIndex::lwmaWindow so that
+ * the window of a child can be derived from its parent in constant time.
+ */
+struct LwmaWindow {
+    //! Sum of the window's targets, each divided by (k N^2) before adding.
+    arith_uint256 sum_target;
+    //! Linearly weighted solvetime sum, the newest block having weight N.
+    int64_t weighted_solvetime{0};
+    //! Unweighted solvetime sum, needed to shift the weights when sliding.
+    int64_t solvetime{0};
+
+    //! Parameters the accumulators were computed with.
+    int64_t N{0};
+    int64_t k{0};
+    bool limit_st{false};
+};
+
+/** Return the (cached) LWMA window ending at pindexLast, computing it from its parent's window when possible. */
+const LwmaWindow& GetLwmaWindow(const CBlockIndex* pindexLast, const Consensus::Params& params);
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
@@ -95,7 +95,14 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITEAS(CBlockHeader, *this);
-        READWRITE(vtx);
+        if (ser_action.ForRead()) {
+            // Compute the hashes of all transactions together
+            std::vector<CMutableTransaction> txs;
+            READWRITE(txs);
+            vtx = MakeTransactionRefs(std::move(txs));
+        } else {
+            READWRITE(vtx);
+        }
     }
 
     void SetNull()
@@ -6,7 +6,9 @@
 
 #include <primitives/transaction.h>
 
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 
@@ -80,6 +82,48 @@ uint256 CTransaction::ComputeWitnessHash() const
 CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
 CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
 CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx, const uint256& hash_in, const uint256& witness_hash_in) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{hash_in}, m_witness_hash{witness_hash_in} {}
+
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs)
+{
+    // Serialize all transactions into one buffer, without witness for the txid
+    // and, for those that have one, with witness for the witness hash. Then
+    // double-SHA256 all of them together.
+    std::vector<unsigned char> buf;
+    std::vector<size_t> offsets{0};
+    std::vector<bool> has_witness(txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        CVectorWriter(SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS, buf, buf.size(), txs[i]);
+        offsets.push_back(buf.size());
+        has_witness[i] = txs[i].HasWitness();
+        if (has_witness[i]) {
+            CVectorWriter(SER_GETHASH, 0, buf, buf.size(), txs[i]);
+            offsets.push_back(buf.size());
+        }
+    }
+
+    const size_t count = offsets.size() - 1;
+    std::vector<uint256> hashes(count);
+    std::vector<unsigned char*> output(count);
+    std::vector<const unsigned char*> input(count);
+    std::vector<size_t> len(count);
+    for (size_t i = 0; i < count; i++) {
+        output[i] = hashes[i].begin();
+        input[i] = buf.data() + offsets[i];
+        len[i] = offsets[i + 1] - offsets[i];
+    }
+    SHA256DBatch(output.data(), input.data(), len.data(), count);
+
+    std::vector<CTransactionRef> ret;
+    ret.reserve(txs.size());
+    size_t pos = 0;
+    for (size_t i = 0; i < txs.size(); i++) {
+        const uint256& hash = hashes[pos++];
+        const uint256& witness_hash = has_witness[i] ? hashes[pos++] : hash;
+        ret.emplace_back(new CTransaction(std::move(txs[i]), hash, witness_hash));
+    }
+    return ret;
+}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -298,6 +298,10 @@ private:
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    /** Convert a CMutableTransaction into a CTransaction whose hashes have been computed already. */
+    CTransaction(CMutableTransaction&& tx, const uint256& hash, const uint256& witness_hash);
+    friend std::vector<std::shared_ptr<const CTransaction>> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -410,4 +414,8 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Convert many transactions at once, hashing them in parallel where possible.
+ *  This is faster than MakeTransactionRef for each, e.g. for the transactions of a block. */
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
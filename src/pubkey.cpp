@@ -4,15 +4,77 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <pubkey.h>
 
+#include <crypto/common.h>
+
 #include <secp256k1.h>
 #include <secp256k1_recovery.h>
 
+#include <string.h>
+#include <vector>
+
 namespace
 {
 /* Global secp256k1_context object used for verification. */
 secp256k1_context* secp256k1_context_verify = nullptr;
+
+#if defined(HAVE_THREAD_LOCAL)
+/**
+ * Public keys recently parsed by one thread for signature verification.
+ *
+ * Parsing decompresses and checks the key, which costs a field square root.
+ * The inputs of a block often spend outputs of the same key, so the script
+ * check threads keep the parsed keys around instead of redoing this for every
+ * signature. Direct-mapped on the first bytes of the key's x coordinate;
+ * collisions just replace the older key.
+ */
+class ParsedPubKeyCache
+{
+    static constexpr size_t ENTRIES = 1024;
+
+    struct Entry {
+        //! The serialized key, all zero while the entry is unused
+        unsigned char vch[CPubKey::PUBLIC_KEY_SIZE];
+        secp256k1_pubkey pubkey;
+    };
+    //! Allocated on first use, as most threads never verify a signature
+    std::vector<Entry> m_entries;
+
+public:
+    bool Parse(const unsigned char* vch, size_t len, secp256k1_pubkey& pubkey)
+    {
+        if (m_entries.empty()) m_entries.resize(ENTRIES);
+        Entry& entry = m_entries[ReadLE32(vch + 1) % ENTRIES];
+        if (memcmp(entry.vch, vch, len) == 0) {
+            pubkey = entry.pubkey;
+            return true;
+        }
+        if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, vch, len)) {
+            return false;
+        }
+        memcpy(entry.vch, vch, len);
+        entry.pubkey = pubkey;
+        return true;
+    }
+};
+
+thread_local ParsedPubKeyCache g_parsed_pubkeys;
+#endif
+
+/** Parse a public key for signature verification, through this thread's cache where available. */
+bool ParsePubKeyForVerify(const unsigned char* vch, size_t len, secp256k1_pubkey& pubkey)
+{
+#if defined(HAVE_THREAD_LOCAL)
+    return g_parsed_pubkeys.Parse(vch, len, pubkey);
+#else
+    return secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, vch, len);
+#endif
+}
 } // namespace
 
 /** This function is taken from the libsecp256k1 distribution and implements
@@ -172,7 +234,7 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
         return false;
     secp256k1_pubkey pubkey;
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, vch, size())) {
+    if (!ParsePubKeyForVerify(vch, size(), pubkey)) {
         return false;
     }
     if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig.data(), vchSig.size())) {
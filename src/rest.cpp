@@ -206,7 +206,12 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    // Blocks are stored on disk in their witness serialization, so binary and
+    // hex requests for that form are answered with the stored bytes as is.
+    const bool raw = (rf == RetFormat::BINARY || rf == RetFormat::HEX) && !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS);
+
     CBlock block;
+    std::vector<uint8_t> block_data;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
     {
@@ -220,8 +225,23 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (raw) {
+            if (!ReadRawBlockFromDisk(block_data, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
+    }
+
+    if (raw) {
+        if (rf == RetFormat::BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, std::string(block_data.begin(), block_data.end()));
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(block_data.begin(), block_data.end()) + "\n");
+        }
+        return true;
     }
 
     switch (rf) {
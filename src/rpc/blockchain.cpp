@@ -16,6 +16,7 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -23,6 +24,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -805,6 +807,21 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
+static std::vector<uint8_t> GetRawBlockChecked(const CBlockIndex* pblockindex)
+{
+    std::vector<uint8_t> data;
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    if (!ReadRawBlockFromDisk(data, pblockindex, Params().MessageStart())) {
+        // See GetBlockChecked
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return data;
+}
+
 static CBlockUndo GetUndoChecked(const CBlockIndex* pblockindex)
 {
     CBlockUndo blockUndo;
@@ -885,7 +902,12 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
+    // Blocks are stored on disk in their witness serialization, so that form
+    // can be returned as is, without deserializing and reserializing the block.
+    const bool raw = verbosity <= 0 && !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS);
+
     CBlock block;
+    std::vector<uint8_t> block_data;
     const CBlockIndex* pblockindex;
     const CBlockIndex* tip;
     {
@@ -897,7 +919,15 @@ static UniValue getblock(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         }
 
-        block = GetBlockChecked(pblockindex);
+        if (raw) {
+            block_data = GetRawBlockChecked(pblockindex);
+        } else {
+            block = GetBlockChecked(pblockindex);
+        }
+    }
+
+    if (raw) {
+        return HexStr(block_data.begin(), block_data.end());
     }
 
     if (verbosity <= 0)
@@ -972,21 +1002,27 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
                 "Note this call may take some time.\n",
-                {},
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'. 'muhash' and 'none' scan the set on multiple threads, or are looked up in the coinstats index when it is enabled."},
+                    {"hash_or_height", RPCArg::Type::NUM, /* default */ "the current best block", "The block hash or height of the target block, only available with coinstatsindex and a hash_type other than 'hash_serialized_2'", "", {"", "string or numeric"}},
+                },
                 RPCResult{
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not available when coinstatsindex is used)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash3072 of the set (only present if 'muhash' hash_type is chosen)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available when coinstatsindex is used)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
                 },
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "muhash")
+            + HelpExampleCli("gettxoutsetinfo", R"("none" 1000)")
             + HelpExampleRpc("gettxoutsetinfo", "")
                 },
             }.Check(request);
@@ -994,17 +1030,85 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    ::ChainstateActive().ForceFlushStateToDisk();
+    CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED;
+    if (!request.params[0].isNull()) {
+        const std::string hash_type_input = request.params[0].get_str();
+        if (hash_type_input == "hash_serialized_2") {
+            hash_type = CoinStatsHashType::HASH_SERIALIZED;
+        } else if (hash_type_input == "muhash") {
+            hash_type = CoinStatsHashType::MUHASH;
+        } else if (hash_type_input == "none") {
+            hash_type = CoinStatsHashType::NONE;
+        } else {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+        }
+    }
+
+    const bool use_index = g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED;
+    if (!request.params[1].isNull() && !use_index) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires coinstatsindex and a hash_type other than 'hash_serialized_2'");
+    }
+
+    bool found;
+    if (use_index) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (request.params[1].isNull()) {
+                pindex = ::ChainActive().Tip();
+            } else if (request.params[1].isNum()) {
+                const int height = request.params[1].get_int();
+                const int current_tip = ::ChainActive().Height();
+                if (height < 0) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+                }
+                if (height > current_tip) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+                }
+                pindex = ::ChainActive()[height];
+            } else {
+                const uint256 hash(ParseHashV(request.params[1], "hash_or_height"));
+                pindex = LookupBlockIndex(hash);
+                if (!pindex) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                }
+            }
+        }
+        found = g_coin_stats_index->LookUpStats(pindex, stats);
+        if (!found) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics; coinstatsindex may still be syncing");
+        }
+    } else {
+        ::ChainstateActive().ForceFlushStateToDisk();
+
+        CCoinsViewDB* coins_view;
+        CCoinsViewAsyncFlush* flusher;
+        {
+            LOCK(cs_main);
+            coins_view = &ChainstateActive().CoinsDB();
+            flusher = &ChainstateActive().CoinsAsyncFlush();
+        }
+        found = GetUTXOStats(coins_view, *flusher, stats, hash_type);
+    }
 
-    CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
+    if (found) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        if (!stats.fFromIndex) {
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        }
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
-        ret.pushKV("disk_size", stats.nDiskSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.hashSerialized.GetHex());
+        }
+        if (!stats.fFromIndex) {
+            ret.pushKV("disk_size", stats.nDiskSize);
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -1445,6 +1549,37 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return MempoolInfoToJSON(::mempool);
 }
 
+static UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getsigcacheinfo",
+                "\nReturns the counters of the signature cache since startup.\n"
+                "\nA high eviction count relative to the inserts suggests raising -maxsigcachesize.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"capacity\": xxxxx,           (numeric) Number of entries the cache can hold\n"
+            "  \"hits\": xxxxx,               (numeric) Signature checks answered from the cache\n"
+            "  \"misses\": xxxxx,             (numeric) Signature checks not found in the cache\n"
+            "  \"inserts\": xxxxx,            (numeric) Valid signatures added to the cache\n"
+            "  \"evictions\": xxxxx           (numeric) Entries dropped or aged out of the cache before a block used them\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+                },
+            }.Check(request);
+
+    const SignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("capacity", (int64_t)stats.nElements);
+    ret.pushKV("hits", (int64_t)stats.nHits);
+    ret.pushKV("misses", (int64_t)stats.nMisses);
+    ret.pushKV("inserts", (int64_t)stats.nInserts);
+    ret.pushKV("evictions", (int64_t)stats.nEvictions);
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
             RPCHelpMan{"preciousblock",
@@ -2272,8 +2407,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        {} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -12,7 +12,8 @@
 #include <util/system.h>
 
 #include <cuckoocache.h>
-#include <boost/thread.hpp>
+
+#include <atomic>
 
 namespace {
 /**
@@ -25,9 +26,12 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    typedef CuckooCache::concurrent_cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    uint32_t nElems{0};
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nInserts{0};
 
 public:
     CSignatureCache()
@@ -44,18 +48,48 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        if (setValid.contains(entry, erase)) {
+            nHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nInserts.fetch_add(1, std::memory_order_relaxed);
         setValid.insert(entry);
     }
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        nElems = setValid.setup_bytes(n);
+        return nElems;
+    }
+
+    void GetSnapshot(uint256& nonce_out, std::vector<uint256>& entries) const
+    {
+        nonce_out = nonce;
+        entries = setValid.elements();
+    }
+
+    void LoadSnapshot(const uint256& nonce_in, const std::vector<uint256>& entries)
+    {
+        nonce = nonce_in;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
+
+    SignatureCacheStats GetStats() const
+    {
+        SignatureCacheStats stats;
+        stats.nElements = nElems;
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        stats.nInserts = nInserts.load(std::memory_order_relaxed);
+        stats.nEvictions = setValid.evictions();
+        return stats;
     }
 };
 
@@ -77,7 +111,22 @@ void InitSignatureCache()
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
     size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu/2 requested for signature cache, able to store %zu elements\n",
-            (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+            (nElems*(sizeof(uint256) + sizeof(uint32_t))) >>20, (nMaxCacheSize*2)>>20, nElems);
+}
+
+void GetSignatureCacheSnapshot(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.GetSnapshot(nonce, entries);
+}
+
+void LoadSignatureCacheSnapshot(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.LoadSnapshot(nonce, entries);
+}
+
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
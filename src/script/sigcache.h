@@ -54,4 +54,27 @@ public:
 
 void InitSignatureCache();
 
+/** Get the nonce and the entries which were not erased yet, to persist the
+ * signature cache across restarts. */
+void GetSignatureCacheSnapshot(uint256& nonce, std::vector<uint256>& entries);
+
+/** Restore a snapshot of the signature cache. Not threadsafe: the nonce is
+ * replaced, so this must happen after InitSignatureCache but before the cache
+ * is used. */
+void LoadSignatureCacheSnapshot(const uint256& nonce, const std::vector<uint256>& entries);
+
+/** Counters of the signature cache since startup. */
+struct SignatureCacheStats
+{
+    //! Number of entries the cache can hold
+    uint32_t nElements;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    //! Entries that left the cache before a block used them: dropped by an insert or aged out
+    uint64_t nEvictions;
+};
+
+SignatureCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
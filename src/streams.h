@@ -196,6 +196,55 @@ public:
     }
 };
 
+/** Minimal stream for reading from an existing byte array by Span.
+ *
+ * Like VectorReader, but the bytes do not need to live in a std::vector, e.g.
+ * because they are memory mapped.
+ */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    Span<const unsigned char> m_data;
+
+public:
+
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced byte range to read from
+     */
+    SpanReader(int type, int version, Span<const unsigned char> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template<typename T>
+    SpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        if (n > (size_t)m_data.size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -299,6 +348,8 @@ public:
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
+    //! Exchange the underlying buffer with another one, so that its memory can be reused elsewhere
+    void swap(vector_type& other)                    { vch.swap(other); nReadPos = 0; }
     iterator insert(iterator it, const char x=char()) { return vch.insert(it, x); }
     void insert(iterator it, size_type n, const char x) { vch.insert(it, n, x); }
     value_type* data()                               { return vch.data() + nReadPos; }
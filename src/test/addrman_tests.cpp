@@ -223,6 +223,41 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3U);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // Test: Select finds the only entry of each table among all their positions.
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+    CService addr2 = ResolveService("250.2.2.2", 8333);
+    BOOST_CHECK(addrman.Add(CAddress(addr1, NODE_NONE), source));
+    BOOST_CHECK(addrman.Add(CAddress(addr2, NODE_NONE), source));
+    addrman.Good(CAddress(addr2, NODE_NONE));
+    BOOST_CHECK_EQUAL(addrman.Select(true).ToString(), "250.1.1.1:8333");
+    std::set<std::string> selected;
+    for (int i = 0; i < 100; ++i) {
+        selected.insert(addrman.Select().ToString());
+    }
+    BOOST_CHECK(selected == std::set<std::string>({"250.1.1.1:8333", "250.2.2.2:8333"}));
+
+    // Test: Select keeps up with entries moving and being deleted.
+    for (unsigned int i = 1; i < 200; i++) {
+        CService addr = ResolveService("251.1." + std::to_string(i / 10) + "." + std::to_string(i));
+        addrman.Add(CAddress(addr, NODE_NONE), ResolveIP("252.3." + std::to_string(i % 7) + ".1"));
+        if (i % 3 == 0) addrman.Good(addr);
+    }
+    addrman.Good(CAddress(addr1, NODE_NONE));
+    for (int i = 0; i < 1000; ++i) {
+        const CAddrInfo ret = addrman.Select(i % 2 == 0);
+        BOOST_CHECK(addrman.Find(ret) != nullptr);
+    }
+
+    addrman.Clear();
+    BOOST_CHECK_EQUAL(addrman.Select().ToString(), "[::]:0");
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -9,6 +9,7 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -54,7 +55,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -65,7 +66,11 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -212,7 +217,12 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    // Keep the cache warm, or trim it to nothing.
+                    BOOST_CHECK(stack[flushIndex]->Sync(InsecureRandBool() ? 0 : std::numeric_limits<size_t>::max()));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -448,7 +458,12 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    // Keep the cache warm, or trim it to nothing.
+                    BOOST_CHECK(stack[flushIndex]->Sync(InsecureRandBool() ? 0 : std::numeric_limits<size_t>::max()));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -480,6 +495,131 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.SetBestBlock(InsecureRand256());
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.out.scriptPubKey.assign(InsecureRandRange(100), 0);
+        coin.nHeight = 1;
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    // Spend some of them before they reach the base.
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    // Spent entries are gone, the others are still cached but no longer modified.
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 90U);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(base.HaveCoin(outpoints[i]), i >= 10);
+        BOOST_CHECK_EQUAL(cache.HaveCoinInCache(outpoints[i]), i >= 10);
+    }
+
+    // Trimming evicts entries until the usage is within the target.
+    const size_t target = cache.DynamicMemoryUsage() / 2;
+    BOOST_CHECK(cache.Sync(target));
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= target);
+    BOOST_CHECK(cache.GetCacheSize() > 0);
+    BOOST_CHECK(cache.GetCacheSize() < 90);
+    std::vector<bool> kept(100);
+    for (int i = 10; i < 100; ++i) {
+        kept[i] = cache.HaveCoinInCache(outpoints[i]);
+    }
+    for (int i = 10; i < 100; ++i) {
+        BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+    }
+
+    // The next trim continues where this one stopped, so it evicts some of
+    // the entries that were kept this time.
+    BOOST_CHECK(cache.Sync(target));
+    cache.SelfTest();
+    int evicted_kept = 0;
+    for (int i = 10; i < 100; ++i) {
+        evicted_kept += kept[i] && !cache.HaveCoinInCache(outpoints[i]);
+    }
+    BOOST_CHECK(evicted_kept > 0);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_async_flush)
+{
+    CCoinsViewTest base;
+    CCoinsViewAsyncFlush async(&base, [](const std::string&) { BOOST_ERROR("flush failed"); });
+    CCoinsViewCacheTest cache(&async);
+
+    std::vector<COutPoint> outpoints;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 50; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            Coin coin;
+            coin.out.nValue = InsecureRand32();
+            coin.nHeight = 1;
+            cache.AddCoin(outpoints.back(), std::move(coin), false);
+        }
+        // Spend a coin committed in an earlier round.
+        if (round > 0) BOOST_CHECK(cache.SpendCoin(outpoints[round]));
+        const uint256 block = InsecureRand256();
+        cache.SetBestBlock(block);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+        // The flushed state is visible right away, whether or not the
+        // background write has finished.
+        BOOST_CHECK(async.GetBestBlock() == block);
+        BOOST_CHECK(cache.GetBestBlock() == block);
+        for (size_t i = round * 50; i < outpoints.size(); ++i) {
+            BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+        }
+        if (round > 0) BOOST_CHECK(!cache.HaveCoin(outpoints[round]));
+        BOOST_CHECK(async.WaitForFlush());
+        BOOST_CHECK(base.GetBestBlock() == block);
+        for (size_t i = 0; i < outpoints.size(); ++i) {
+            // The test base view may keep spent entries around, and report them.
+            Coin coin;
+            const bool unspent = base.GetCoin(outpoints[i], coin) && !coin.IsSpent();
+            BOOST_CHECK(unspent != (i >= 1 && i <= (size_t)round));
+        }
+    }
+
+    // Syncing copies the modified entries into the batch and keeps every
+    // unspent entry cached, no longer modified.
+    Coin coin;
+    coin.out.nValue = 1;
+    coin.nHeight = 1;
+    const COutPoint added(InsecureRand256(), 0);
+    cache.AddCoin(added, std::move(coin), false);
+    BOOST_CHECK(cache.AccessCoin(outpoints[0]).out.nValue > 0);
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK(cache.HaveCoinInCache(added));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[0]));
+    BOOST_CHECK_EQUAL(cache.map().find(added)->second.flags, 0);
+    BOOST_CHECK(async.WaitForFlush());
+    BOOST_CHECK_EQUAL(async.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(base.HaveCoin(added));
+
+    // A failed write is reported as soon as it happens.
+    CCoinsView failing;
+    std::string failure;
+    CCoinsViewAsyncFlush failing_async(&failing, [&failure](const std::string& msg) { failure = msg; });
+    CCoinsMap map;
+    map[added].flags = CCoinsCacheEntry::DIRTY;
+    BOOST_CHECK(failing_async.BatchWrite(map, InsecureRand256()));
+    BOOST_CHECK(!failing_async.WaitForFlush());
+    BOOST_CHECK_EQUAL(failure, "Failed to write to coin database");
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
     // Good example
@@ -663,6 +803,36 @@ BOOST_AUTO_TEST_CASE(ccoins_access)
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* Check that adding a coin read from the base view with AddFetchedCoin
+     * leaves the cache in the same state as a cache miss in AccessCoin.
+     */
+    for (const CAmount base_value : {ABSENT, PRUNED, VALUE1}) {
+        for (const CAmount cache_value : {ABSENT, PRUNED, VALUE2}) {
+            for (const char cache_flags : cache_value == ABSENT ? ABSENT_FLAGS : FLAGS) {
+                SingleEntryCacheTest accessed(base_value, cache_value, cache_flags);
+                accessed.cache.AccessCoin(OUTPOINT);
+
+                SingleEntryCacheTest fetched(base_value, cache_value, cache_flags);
+                Coin coin;
+                if (fetched.base.GetCoin(OUTPOINT, coin)) {
+                    fetched.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+                }
+                fetched.cache.SelfTest();
+
+                CAmount accessed_value, fetched_value;
+                char accessed_flags, fetched_flags;
+                GetCoinsMapEntry(accessed.cache.map(), accessed_value, accessed_flags);
+                GetCoinsMapEntry(fetched.cache.map(), fetched_value, fetched_flags);
+                BOOST_CHECK_EQUAL(fetched_value, accessed_value);
+                BOOST_CHECK_EQUAL(fetched_flags, accessed_flags);
+                BOOST_CHECK_EQUAL(fetched.cache.DynamicMemoryUsage(), accessed.cache.DynamicMemoryUsage());
+            }
+        }
+    }
+}
+
 static void CheckSpendCoins(CAmount base_value, CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
 {
     SingleEntryCacheTest test(base_value, cache_value, cache_flags);
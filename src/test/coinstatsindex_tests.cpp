@@ -0,0 +1,126 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    CCoinsStats coin_stats;
+    const CBlockIndex* block_index;
+    {
+        LOCK(cs_main);
+        block_index = ::ChainActive().Tip();
+    }
+
+    // Stats should not be found in the index before it is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(block_index, coin_stats));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // The genesis block outputs are not part of the UTXO set.
+    CCoinsStats genesis_stats;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(coin_stats_index.LookUpStats(::ChainActive().Genesis(), genesis_stats));
+    }
+    BOOST_CHECK_EQUAL(genesis_stats.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(genesis_stats.nTotalAmount, 0);
+
+    // The indexed stats of the tip match a scan of the UTXO set.
+    auto check_tip = [&] {
+        ::ChainstateActive().ForceFlushStateToDisk();
+        CCoinsViewDB* coins_view = WITH_LOCK(cs_main, return &::ChainstateActive().CoinsDB());
+        CCoinsViewAsyncFlush* flusher = WITH_LOCK(cs_main, return &::ChainstateActive().CoinsAsyncFlush());
+        CCoinsStats scan_stats;
+        BOOST_REQUIRE(GetUTXOStats(coins_view, *flusher, scan_stats, CoinStatsHashType::MUHASH));
+
+        CCoinsStats index_stats;
+        const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        BOOST_REQUIRE(coin_stats_index.LookUpStats(tip, index_stats));
+        BOOST_CHECK(index_stats.fFromIndex);
+        BOOST_CHECK_EQUAL(index_stats.nHeight, scan_stats.nHeight);
+        BOOST_CHECK(index_stats.hashBlock == scan_stats.hashBlock);
+        BOOST_CHECK_EQUAL(index_stats.nTransactionOutputs, scan_stats.nTransactionOutputs);
+        BOOST_CHECK_EQUAL(index_stats.nBogoSize, scan_stats.nBogoSize);
+        BOOST_CHECK_EQUAL(index_stats.nTotalAmount, scan_stats.nTotalAmount);
+        BOOST_CHECK(index_stats.hashSerialized == scan_stats.hashSerialized);
+    };
+    check_tip();
+
+    // Spend a coinbase output in a new block, so that inputs are removed from the set as well.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, m_coinbase_txns[0]->vout[0].nValue, SigVersion::BASE, true);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK_EQUAL(block.vtx.size(), 2U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(::ChainActive().Tip()->GetBlockHash() == block.GetHash());
+    }
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    check_tip();
+    CCoinsStats spend_stats;
+    BOOST_CHECK(coin_stats_index.LookUpStats(WITH_LOCK(cs_main, return ::ChainActive().Tip()), spend_stats));
+
+    // Replace the block by another one. The index takes the replaced block back out of its
+    // running MuHash, and still knows the stats of the replaced block.
+    CBlockIndex* spend_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    {
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), spend_index));
+    }
+    CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    check_tip();
+    CCoinsStats replaced_stats;
+    BOOST_CHECK(coin_stats_index.LookUpStats(spend_index, replaced_stats));
+    BOOST_CHECK(replaced_stats.hashSerialized == spend_stats.hashSerialized);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coin_stats_index.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,11 +10,13 @@
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
 #include <random.h>
+#include <streams.h>
 #include <util/strencodings.h>
 #include <test/setup_common.h>
 
@@ -750,4 +752,148 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_batch)
+{
+    // Messages of every length up to three blocks, so that each lane sees
+    // messages of different block counts and padding in one or two blocks.
+    std::vector<std::vector<unsigned char>> msgs(193);
+    std::vector<unsigned char*> output(msgs.size());
+    std::vector<const unsigned char*> input(msgs.size());
+    std::vector<size_t> len(msgs.size());
+    std::vector<uint256> hashes(msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        msgs[i] = g_insecure_rand_ctx.randbytes(i);
+        output[i] = hashes[i].begin();
+        input[i] = msgs[i].data();
+        len[i] = i;
+    }
+    for (size_t count = 0; count <= msgs.size(); count += 17) {
+        SHA256DBatch(output.data(), input.data(), len.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            uint256 expected;
+            CHash256().Write(msgs[i].data(), msgs[i].size()).Finalize(expected.begin());
+            BOOST_CHECK(hashes[i] == expected);
+        }
+    }
+}
+
+static std::vector<unsigned char> NumToBytes(Num3072 num)
+{
+    unsigned char out[Num3072::BYTE_SIZE];
+    num.ToBytes(out);
+    return std::vector<unsigned char>(out, out + Num3072::BYTE_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(num3072_arithmetic)
+{
+    const std::vector<unsigned char> one = NumToBytes(Num3072());
+
+    // p - 1, p - 2 and 2, with p = 2^3072 - 1103717
+    Num3072 minus_one, minus_two, two;
+    for (int i = 0; i < Num3072::LIMBS; ++i) {
+        minus_one.limbs[i] = minus_two.limbs[i] = std::numeric_limits<Num3072::limb_t>::max();
+        two.limbs[i] = 0;
+    }
+    minus_one.limbs[0] -= 1103717;
+    minus_two.limbs[0] -= 1103717 + 1;
+    two.limbs[0] = 2;
+
+    Num3072 product = minus_one;
+    product.Multiply(minus_one);
+    BOOST_CHECK(NumToBytes(product) == one);
+    product = minus_one;
+    product.Multiply(two);
+    BOOST_CHECK(NumToBytes(product) == NumToBytes(minus_two));
+    product = minus_one.GetInverse();
+    BOOST_CHECK(NumToBytes(product) == NumToBytes(minus_one));
+
+    for (int i = 0; i < 3; ++i) {
+        unsigned char data[Num3072::BYTE_SIZE];
+        for (unsigned char& byte : data) byte = InsecureRandBits(8);
+        Num3072 x(data);
+        Num3072 x_inv = x.GetInverse();
+        x_inv.Multiply(x);
+        BOOST_CHECK(NumToBytes(x_inv) == one);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_operations)
+{
+    std::vector<std::vector<unsigned char>> elements(4);
+    for (auto& element : elements) {
+        element = g_insecure_rand_ctx.randbytes(1 + InsecureRandRange(64));
+    }
+
+    uint256 empty, hash1, hash2;
+    MuHash3072().Finalize(empty);
+
+    // Insertion order does not matter
+    MuHash3072 acc1, acc2;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        acc1.Insert(MakeSpan(elements[i]));
+        acc2.Insert(MakeSpan(elements[elements.size() - 1 - i]));
+    }
+    acc1.Finalize(hash1);
+    acc2.Finalize(hash2);
+    BOOST_CHECK(hash1 == hash2);
+    BOOST_CHECK(hash1 != empty);
+
+    // Combining the hashes of disjoint sets gives the hash of their union
+    MuHash3072 left(MakeSpan(elements[0])), right(MakeSpan(elements[2]));
+    left.Insert(MakeSpan(elements[1]));
+    right.Insert(MakeSpan(elements[3]));
+    left *= right;
+    left.Finalize(hash2);
+    BOOST_CHECK(hash1 == hash2);
+
+    // Removing elements, before or after inserting them, cancels them out
+    MuHash3072 acc3;
+    acc3.Remove(MakeSpan(elements[3]));
+    acc3.Insert(MakeSpan(elements[0])).Insert(MakeSpan(elements[1])).Insert(MakeSpan(elements[2]));
+    acc3.Insert(MakeSpan(elements[3])).Insert(MakeSpan(elements[3]));
+    acc3.Finalize(hash2);
+    BOOST_CHECK(hash1 == hash2);
+    acc3 /= acc1;
+    acc3.Finalize(hash2);
+    BOOST_CHECK(hash2 == empty);
+
+    // Serialization round trip keeps the set
+    CDataStream ss(SER_DISK, 0);
+    MuHash3072 acc4(MakeSpan(elements[1]));
+    acc4.Remove(MakeSpan(elements[0]));
+    ss << acc4;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc5;
+    ss >> acc5;
+    acc4.Finalize(hash1);
+    acc5.Finalize(hash2);
+    BOOST_CHECK(hash1 == hash2);
+}
+
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(MakeSpan(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_known_answer)
+{
+    // Vector from the MuHash3072 tests of Bitcoin Core (src/test/crypto_tests.cpp),
+    // which uses the same element hashing, modulus and finalization.
+    uint256 out;
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    MuHash3072 acc2 = FromInt(0);
+    unsigned char tmp[32] = {1, 0};
+    acc2.Insert(MakeSpan(tmp));
+    unsigned char tmp2[32] = {2, 0};
+    acc2.Remove(MakeSpan(tmp2));
+    acc2.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
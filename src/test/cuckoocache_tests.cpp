@@ -9,6 +9,8 @@
 #include <random.h>
 #include <thread>
 #include <deque>
+#include <atomic>
+#include <algorithm>
 
 /** Test Suite for CuckooCache
  *
@@ -53,8 +55,8 @@ static double test_cache(size_t megabytes, double load)
     std::vector<uint256> hashes;
     Cache set{};
     size_t bytes = megabytes * (1 << 20);
-    set.setup_bytes(bytes);
-    uint32_t n_insert = static_cast<uint32_t>(load * (bytes / sizeof(uint256)));
+    const uint32_t n_slots = set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(load * n_slots);
     hashes.resize(n_insert);
     for (uint32_t i = 0; i < n_insert; ++i) {
         uint32_t* ptr = (uint32_t*)hashes[i].begin();
@@ -110,6 +112,8 @@ BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
     for (double load = 0.1; load < 2; load *= 2) {
         double hits = test_cache<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes, load);
         BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
+        hits = test_cache<CuckooCache::concurrent_cache<uint256, SignatureCacheHasher>>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
     }
 }
 
@@ -124,8 +128,8 @@ static void test_cache_erase(size_t megabytes)
     std::vector<uint256> hashes;
     Cache set{};
     size_t bytes = megabytes * (1 << 20);
-    set.setup_bytes(bytes);
-    uint32_t n_insert = static_cast<uint32_t>(load * (bytes / sizeof(uint256)));
+    const uint32_t n_slots = set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(load * n_slots);
     hashes.resize(n_insert);
     for (uint32_t i = 0; i < n_insert; ++i) {
         uint32_t* ptr = (uint32_t*)hashes[i].begin();
@@ -177,6 +181,7 @@ BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
 {
     size_t megabytes = 4;
     test_cache_erase<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes);
+    test_cache_erase<CuckooCache::concurrent_cache<uint256, SignatureCacheHasher>>(megabytes);
 }
 
 template <typename Cache>
@@ -187,8 +192,8 @@ static void test_cache_erase_parallel(size_t megabytes)
     std::vector<uint256> hashes;
     Cache set{};
     size_t bytes = megabytes * (1 << 20);
-    set.setup_bytes(bytes);
-    uint32_t n_insert = static_cast<uint32_t>(load * (bytes / sizeof(uint256)));
+    const uint32_t n_slots = set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(load * n_slots);
     hashes.resize(n_insert);
     for (uint32_t i = 0; i < n_insert; ++i) {
         uint32_t* ptr = (uint32_t*)hashes[i].begin();
@@ -266,9 +271,87 @@ BOOST_AUTO_TEST_CASE(cuckoocache_erase_parallel_ok)
 {
     size_t megabytes = 4;
     test_cache_erase_parallel<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes);
+    test_cache_erase_parallel<CuckooCache::concurrent_cache<uint256, SignatureCacheHasher>>(megabytes);
+}
+
+/** Insert from several threads at once, while they also look up their own
+ * and never inserted elements, without any locking.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent_insert_ok)
+{
+    SeedInsecureRand(true);
+    const size_t bytes = 4 << 20;
+    CuckooCache::concurrent_cache<uint256, SignatureCacheHasher> set{};
+    const uint32_t n_slots = set.setup_bytes(bytes);
+    const uint32_t n_threads = 4;
+    const uint32_t n_insert = n_slots / 2;
+    std::vector<uint256> hashes(n_insert);
+    for (uint256& h : hashes)
+        h = InsecureRand256();
+    std::vector<uint256> fakes(n_insert);
+    for (uint256& h : fakes)
+        h = InsecureRand256();
+
+    std::atomic<uint32_t> fake_hits{0};
+    std::vector<std::thread> threads;
+    for (uint32_t x = 0; x < n_threads; ++x)
+        threads.emplace_back([&, x] {
+            for (uint32_t i = x; i < n_insert; i += n_threads) {
+                set.insert(hashes[i]);
+                set.contains(hashes[i - i / 2], false);
+                fake_hits += set.contains(fakes[i], false);
+            }
+        });
+    for (std::thread& t : threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(fake_hits, 0U);
+    uint32_t count = 0;
+    for (const uint256& h : hashes)
+        count += set.contains(h, false);
+    // At half load, only inserts that found a slot busy may have dropped an
+    // element.
+    BOOST_CHECK(double(count) / n_insert > 0.99);
+    BOOST_CHECK(set.evictions() < n_insert / 100);
 }
 
 
+/** Check that elements() returns exactly the elements which were inserted and
+ * not erased, and that they can be inserted into a new cache.
+ */
+template <typename Cache>
+static void test_cache_elements()
+{
+    SeedInsecureRand(true);
+    Cache set{};
+    set.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        h = InsecureRand256();
+        set.insert(h);
+    }
+    for (uint32_t i = 0; i < 100; ++i)
+        BOOST_CHECK(set.contains(hashes[i], true));
+
+    std::vector<uint256> elements = set.elements();
+    std::sort(elements.begin(), elements.end());
+    std::vector<uint256> expected(hashes.begin() + 100, hashes.end());
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(elements == expected);
+
+    Cache reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    for (const uint256& h : set.elements())
+        reloaded.insert(h);
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(reloaded.contains(hashes[i], false), i >= 100);
+}
+BOOST_AUTO_TEST_CASE(cuckoocache_elements)
+{
+    test_cache_elements<CuckooCache::cache<uint256, SignatureCacheHasher>>();
+    test_cache_elements<CuckooCache::concurrent_cache<uint256, SignatureCacheHasher>>();
+}
+
 template <typename Cache>
 static void test_cache_generations()
 {
@@ -362,6 +445,7 @@ static void test_cache_generations()
 BOOST_AUTO_TEST_CASE(cuckoocache_generations)
 {
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
+    test_cache_generations<CuckooCache::concurrent_cache<uint256, SignatureCacheHasher>>();
 }
 
 BOOST_AUTO_TEST_SUITE_END();
@@ -13,6 +13,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <serialize.h>
+#include <txmempool.h>
 #include <util/memory.h>
 #include <util/system.h>
 #include <util/time.h>
@@ -448,4 +449,139 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_AUTO_TEST_CASE(tx_announcement_batch_expiry)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false);
+
+    TestMemPoolEntryHelper entry;
+    auto add_tx = [&entry] {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        LOCK2(cs_main, mempool.cs);
+        mempool.addUnchecked(entry.FromTx(tx));
+        return tx.GetHash();
+    };
+    const uint256 txid = add_tx();
+
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < 2; ++i) {
+        nodes.emplace_back(new CNode(id++, ServiceFlags(NODE_NETWORK | NODE_WITNESS), 0, INVALID_SOCKET, CAddress(ip(0xa0b0c001 + i), NODE_NONE), 0, 0, CAddress(), "", /*fInboundIn=*/ false));
+        CNode& node = *nodes.back();
+        node.SetSendVersion(PROTOCOL_VERSION);
+        peerLogic->InitializeNode(&node);
+        node.nVersion = PROTOCOL_VERSION;
+        node.fSuccessfullyConnected = true;
+        WITH_LOCK(node.m_tx_relay->cs_filter, node.m_tx_relay->fRelayTxes = true);
+        node.PushInventory(CInv(MSG_TX, txid));
+    }
+
+    // The first peer puts the transaction in the shared batch.
+    const int64_t now = GetTime();
+    SetMockTime(now);
+    {
+        LOCK2(cs_main, nodes[0]->cs_sendProcessing);
+        BOOST_CHECK(peerLogic->SendMessages(nodes[0].get()));
+    }
+
+    // The entry expires while the second peer still has the transaction
+    // queued, and the batch is rebuilt for a change to the mempool. The
+    // second peer gets the transaction back into the batch and announces it.
+    SetMockTime(now + 3 * 60);
+    add_tx();
+    {
+        LOCK2(cs_main, nodes[1]->cs_sendProcessing);
+        BOOST_CHECK(peerLogic->SendMessages(nodes[1].get()));
+    }
+    for (const auto& node : nodes) {
+        LOCK(node->m_tx_relay->cs_tx_inventory);
+        BOOST_CHECK(node->m_tx_relay->setInventoryTxToSend.empty());
+        BOOST_CHECK(node->m_tx_relay->filterInventoryKnown.contains(txid));
+    }
+
+    SetMockTime(0);
+    for (const auto& node : nodes) {
+        bool dummy;
+        peerLogic->FinalizeNode(node->GetId(), dummy);
+    }
+    LOCK2(cs_main, mempool.cs);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(tx_announcement_batch_interval)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false);
+
+    TestMemPoolEntryHelper entry;
+    auto add_tx = [&entry] {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        LOCK2(cs_main, mempool.cs);
+        mempool.addUnchecked(entry.FromTx(tx));
+        return tx.GetHash();
+    };
+
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < 3; ++i) {
+        nodes.emplace_back(new CNode(id++, ServiceFlags(NODE_NETWORK | NODE_WITNESS), 0, INVALID_SOCKET, CAddress(ip(0xa0b0c001 + i), NODE_NONE), 0, 0, CAddress(), "", /*fInboundIn=*/ false));
+        CNode& node = *nodes.back();
+        node.SetSendVersion(PROTOCOL_VERSION);
+        peerLogic->InitializeNode(&node);
+        node.nVersion = PROTOCOL_VERSION;
+        node.fSuccessfullyConnected = true;
+        WITH_LOCK(node.m_tx_relay->cs_filter, node.m_tx_relay->fRelayTxes = true);
+    }
+    auto send = [&](CNode& node) {
+        LOCK2(cs_main, node.cs_sendProcessing);
+        BOOST_CHECK(peerLogic->SendMessages(&node));
+    };
+
+    // The first peer's trickle builds the batch.
+    const uint256 txid = add_tx();
+    nodes[0]->PushInventory(CInv(MSG_TX, txid));
+    const int64_t now = GetTime() + 60 * 60;
+    SetMockTime(now);
+    send(*nodes[0]);
+
+    // Within the interval the batch is reused: a transaction added since
+    // stays queued, while those in the batch are announced.
+    const uint256 txid_later = add_tx();
+    nodes[1]->PushInventory(CInv(MSG_TX, txid));
+    nodes[1]->PushInventory(CInv(MSG_TX, txid_later));
+    send(*nodes[1]);
+    {
+        LOCK(nodes[1]->m_tx_relay->cs_tx_inventory);
+        BOOST_CHECK(nodes[1]->m_tx_relay->filterInventoryKnown.contains(txid));
+        BOOST_CHECK(!nodes[1]->m_tx_relay->filterInventoryKnown.contains(txid_later));
+        BOOST_CHECK_EQUAL(nodes[1]->m_tx_relay->setInventoryTxToSend.size(), 1U);
+        BOOST_CHECK_EQUAL(nodes[1]->m_tx_relay->setInventoryTxToSend.count(txid_later), 1U);
+    }
+
+    // Once the interval has passed, the next trickle rebuilds the batch with
+    // the transactions that were missing from it.
+    SetMockTime(now + 60);
+    nodes[2]->PushInventory(CInv(MSG_TX, txid_later));
+    send(*nodes[2]);
+    {
+        LOCK(nodes[2]->m_tx_relay->cs_tx_inventory);
+        BOOST_CHECK(nodes[2]->m_tx_relay->setInventoryTxToSend.empty());
+        BOOST_CHECK(nodes[2]->m_tx_relay->filterInventoryKnown.contains(txid_later));
+    }
+
+    SetMockTime(0);
+    for (const auto& node : nodes) {
+        bool dummy;
+        peerLogic->FinalizeNode(node->GetId(), dummy);
+    }
+    LOCK2(cs_main, mempool.cs);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -124,4 +124,62 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(flatfile_map_cache)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "m", 100);
+    FlatFileMapCache maps(seq, 2);
+
+    std::string text("Commerce on the Internet has come to rely almost exclusively on financial institutions.");
+    const size_t text_size = GetSerializeSize(text, CLIENT_VERSION);
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << text;
+    }
+
+    // Missing files and ranges beyond the end of a file cannot be mapped.
+    BOOST_CHECK(!maps.Get(1, 0));
+    BOOST_CHECK(!maps.Get(0, text_size + 1));
+
+    auto mapped = maps.Get(0, text_size);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), text_size);
+    BOOST_CHECK(maps.Get(0, 1) == mapped);
+
+    std::string read;
+    SpanReader(SER_DISK, CLIENT_VERSION, mapped->Range(0, text_size)) >> read;
+    BOOST_CHECK_EQUAL(read, text);
+    BOOST_CHECK_EQUAL(mapped->Range(1, text_size).size(), 0);
+
+    // Appending to the file makes the next long enough request remap it,
+    // while the old mapping stays readable.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, text_size)), SER_DISK, CLIENT_VERSION);
+        file << text;
+    }
+    auto remapped = maps.Get(0, 2 * text_size);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    SpanReader(SER_DISK, CLIENT_VERSION, remapped->Range(text_size, text_size)) >> read;
+    BOOST_CHECK_EQUAL(read, text);
+    SpanReader(SER_DISK, CLIENT_VERSION, mapped->Range(0, text_size)) >> read;
+    BOOST_CHECK_EQUAL(read, text);
+
+    // Only the two most recently used files stay mapped.
+    for (int n = 1; n <= 2; n++) {
+        CAutoFile file(seq.Open(FlatFilePos(n, 0)), SER_DISK, CLIENT_VERSION);
+        file << text;
+    }
+    auto mapped1 = maps.Get(1, text_size);
+    auto mapped2 = maps.Get(2, text_size);
+    BOOST_CHECK(maps.Get(2, text_size) == mapped2);
+    BOOST_CHECK(maps.Get(1, text_size) == mapped1);
+    BOOST_CHECK(maps.Get(0, text_size) != remapped);
+
+    maps.Erase(1);
+    BOOST_CHECK(maps.Get(1, text_size) != mapped1);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,209 @@
+// Copyright (c) 2020 The Bitcoin Global developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatmap.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <test/setup_common.h>
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+typedef flatmap<uint32_t, std::string> TestMap;
+
+static void CheckEqual(const TestMap& map, const std::map<uint32_t, std::string>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    size_t visited = 0;
+    for (const auto& entry : map) {
+        auto it = expected.find(entry.first);
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK_EQUAL(entry.second, it->second);
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_random_operations)
+{
+    FastRandomContext ctx(true);
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+
+    for (int i = 0; i < 100000; ++i) {
+        const uint32_t key = ctx.randrange(2000);
+        switch (ctx.randrange(5)) {
+        case 0: {
+            auto ret = map.emplace(key, std::to_string(i));
+            BOOST_CHECK_EQUAL(ret.second, expected.emplace(key, std::to_string(i)).second);
+            BOOST_CHECK_EQUAL(ret.first->second, expected[key]);
+            break;
+        }
+        case 1:
+            map[key] += "x";
+            expected[key] += "x";
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+            break;
+        case 3: {
+            auto it = map.find(key);
+            auto expected_it = expected.find(key);
+            BOOST_CHECK((it == map.end()) == (expected_it == expected.end()));
+            if (it != map.end() && expected_it != expected.end()) {
+                BOOST_CHECK_EQUAL(it->second, expected_it->second);
+            }
+            break;
+        }
+        case 4:
+            if (ctx.randrange(1000) == 0) CheckEqual(map, expected);
+            break;
+        }
+    }
+    CheckEqual(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_erase_while_iterating)
+{
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        map.emplace(i, std::to_string(i));
+        expected.emplace(i, std::to_string(i));
+    }
+
+    // Erasing with erase(it++) visits every remaining entry exactly once.
+    size_t visited = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        ++visited;
+        if (it->first % 3 == 0) {
+            expected.erase(it->first);
+            map.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    BOOST_CHECK_EQUAL(visited, 1000U);
+    CheckEqual(map, expected);
+
+    // And so does it = erase(it).
+    visited = 0;
+    for (auto it = map.begin(); it != map.end(); it = map.erase(it)) {
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, expected.size());
+    BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_reference_stability)
+{
+    TestMap map;
+    std::string& first = map[0];
+    first = "first";
+    const std::string* address = &first;
+    // Growing the table many times over must not move existing entries.
+    for (uint32_t i = 1; i < 10000; ++i) {
+        map[i] = std::to_string(i);
+    }
+    BOOST_CHECK_EQUAL(&map.find(0)->second, address);
+    BOOST_CHECK_EQUAL(*address, "first");
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_memory_usage)
+{
+    TestMap map;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+    for (uint32_t i = 0; i < 10000; ++i) {
+        map.emplace(i, std::string());
+    }
+    const size_t usage = memusage::DynamicUsage(map);
+    // At least the entries themselves, and no more than the pool plus a half
+    // empty table of 8 byte slots would need.
+    BOOST_CHECK(usage >= 10000 * sizeof(TestMap::value_type));
+    BOOST_CHECK(usage <= 2 * 10000 * sizeof(TestMap::value_type) + 4 * 10000 * 8);
+
+    map.clear();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_compact)
+{
+    TestMap map;
+    std::map<uint32_t, std::string> expected;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        map.emplace(i, std::to_string(i));
+        expected.emplace(i, std::to_string(i));
+    }
+    const size_t usage = memusage::DynamicUsage(map);
+    const size_t slots = map.slot_count();
+
+    // Erased entries are still counted until the map is compacted.
+    for (uint32_t i = 0; i < 10000; ++i) {
+        if (i % 10 == 0) continue;
+        map.erase(i);
+        expected.erase(i);
+    }
+    BOOST_CHECK(memusage::DynamicUsage(map) >= usage);
+
+    map.compact();
+    CheckEqual(map, expected);
+    for (const auto& entry : expected) {
+        auto it = map.find(entry.first);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, entry.second);
+    }
+    BOOST_CHECK_EQUAL(map.reusable_bytes(), 0U);
+    BOOST_CHECK(map.slot_count() < slots);
+    BOOST_CHECK(memusage::DynamicUsage(map) < usage / 4);
+
+    // The map stays usable.
+    for (uint32_t i = 10000; i < 11000; ++i) {
+        map.emplace(i, std::to_string(i));
+        expected.emplace(i, std::to_string(i));
+    }
+    map.erase(0);
+    expected.erase(0);
+    CheckEqual(map, expected);
+
+    for (const auto& entry : expected) {
+        map.erase(entry.first);
+    }
+    map.compact();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_emplace_existing)
+{
+    TestMap map;
+    for (uint32_t i = 0; i < 100; ++i) {
+        map.emplace(i, std::to_string(i));
+    }
+    const size_t usage = memusage::DynamicUsage(map);
+    // Emplacing keys that are present must neither construct an entry in the
+    // pool nor leave a node on the free list.
+    for (uint32_t i = 0; i < 100; ++i) {
+        auto ret = map.emplace(i, "other");
+        BOOST_CHECK(!ret.second);
+        BOOST_CHECK_EQUAL(ret.first->second, std::to_string(i));
+        ret = map.emplace(std::piecewise_construct, std::forward_as_tuple(i), std::forward_as_tuple("other"));
+        BOOST_CHECK(!ret.second);
+        BOOST_CHECK_EQUAL(ret.first->second, std::to_string(i));
+    }
+    BOOST_CHECK_EQUAL(map.reusable_bytes(), 0U);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+    BOOST_CHECK_EQUAL(map.size(), 100U);
+
+    auto ret = map.emplace(std::piecewise_construct, std::forward_as_tuple(100), std::tuple<>());
+    BOOST_CHECK(ret.second);
+    BOOST_CHECK(ret.first->second.empty());
+    BOOST_CHECK_EQUAL(map.size(), 101U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
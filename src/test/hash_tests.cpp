@@ -146,6 +146,30 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between the batch and single value versions, for
+    // counts that do and don't fill all lanes of the multi-lane versions.
+    for (size_t count = 0; count <= 19; ++count) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        std::vector<uint256> vals(count);
+        std::vector<const uint256*> ptrs(count);
+        std::vector<uint32_t> extras(count);
+        for (size_t i = 0; i < count; ++i) {
+            vals[i] = InsecureRand256();
+            ptrs[i] = &vals[i];
+            extras[i] = ctx.rand32();
+        }
+        std::vector<uint64_t> out(count);
+        SipHashUint256Batch(k1, k2, ptrs.data(), count, out.data());
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(k1, k2, vals[i]));
+        }
+        SipHashUint256ExtraBatch(k1, k2, ptrs.data(), extras.data(), count, out.data());
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256Extra(k1, k2, vals[i], extras[i]));
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
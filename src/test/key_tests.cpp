@@ -220,4 +220,38 @@ BOOST_AUTO_TEST_CASE(key_key_negation)
     BOOST_CHECK(key.GetPubKey().data()[0] == 0x03);
 }
 
+BOOST_AUTO_TEST_CASE(key_verify_repeated)
+{
+    // Verifying with a key parses it once per thread and reuses the result;
+    // keys that only share their x coordinate must not be mixed up.
+    const uint256 hash = InsecureRand256();
+    CKey key = DecodeSecret(strSecret1C);
+    const CPubKey pubkey = key.GetPubKey();
+    std::vector<unsigned char> sig;
+    BOOST_CHECK(key.Sign(hash, sig));
+
+    CKey negated = key;
+    negated.Negate();
+    const CPubKey pubkey_negated = negated.GetPubKey();
+    BOOST_CHECK(std::equal(pubkey.begin() + 1, pubkey.end(), pubkey_negated.begin() + 1));
+    std::vector<unsigned char> sig_negated;
+    BOOST_CHECK(negated.Sign(hash, sig_negated));
+
+    CPubKey pubkey_uncompressed = pubkey;
+    BOOST_CHECK(pubkey_uncompressed.Decompress());
+    // Same x coordinate, but not on the curve
+    std::vector<unsigned char> invalid(pubkey_uncompressed.begin(), pubkey_uncompressed.end());
+    invalid.back() ^= 1;
+    const CPubKey pubkey_invalid(invalid);
+
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(pubkey.Verify(hash, sig));
+        BOOST_CHECK(!pubkey.Verify(hash, sig_negated));
+        BOOST_CHECK(pubkey_negated.Verify(hash, sig_negated));
+        BOOST_CHECK(!pubkey_negated.Verify(hash, sig));
+        BOOST_CHECK(pubkey_uncompressed.Verify(hash, sig));
+        BOOST_CHECK(!pubkey_invalid.Verify(hash, sig));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
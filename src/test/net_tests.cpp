@@ -13,6 +13,7 @@
 #include <streams.h>
 #include <net.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <chainparams.h>
 #include <util/memory.h>
 #include <util/system.h>
@@ -136,6 +137,45 @@ BOOST_AUTO_TEST_CASE(caddrdb_read)
 }
 
 
+BOOST_AUTO_TEST_CASE(caddrdb_write_read)
+{
+    CAddrManUncorrupted addrman;
+    addrman.MakeDeterministic();
+    CService source;
+    BOOST_CHECK(Lookup("252.5.1.1", source, 8333, false));
+    for (int i = 1; i <= 50; i++) {
+        CService addr;
+        BOOST_CHECK(Lookup(strprintf("250.7.%d.%d", i, i).c_str(), addr, 8333, false));
+        BOOST_CHECK(addrman.Add(CAddress(addr, NODE_NONE), source));
+    }
+
+    CAddrDB adb;
+    BOOST_REQUIRE(adb.Write(addrman));
+
+    // The file holds the magic and addrman, followed by their hash.
+    FILE* file = fsbridge::fopen(GetDataDir() / "peers.dat", "rb");
+    BOOST_REQUIRE(file != nullptr);
+    std::vector<unsigned char> contents;
+    unsigned char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+        contents.insert(contents.end(), buf, buf + len);
+    }
+    fclose(file);
+    BOOST_REQUIRE(contents.size() > 32);
+    const CDataStream stream = AddrmanToStream(addrman);
+    const std::vector<unsigned char> expected(stream.begin(), stream.end());
+    BOOST_CHECK(std::equal(expected.begin(), expected.end(), contents.begin()));
+    BOOST_CHECK_EQUAL(expected.size() + 32, contents.size());
+    const uint256 hash = Hash(contents.begin(), contents.end() - 32);
+    BOOST_CHECK(std::equal(hash.begin(), hash.end(), contents.end() - 32));
+
+    CAddrMan addrman2;
+    BOOST_CHECK(adb.Read(addrman2));
+    BOOST_CHECK(addrman2.size() > 0);
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+}
+
 BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
 {
     CAddrManCorrupted addrmanCorrupted;
@@ -305,4 +345,67 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
 }
 
 
+BOOST_AUTO_TEST_CASE(shared_net_msg_wire_format)
+{
+    CSerializedNetMsg msg = CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, uint64_t{42});
+    const std::vector<unsigned char> payload = msg.data;
+    const CSharedNetMsg shared(std::move(msg));
+
+    BOOST_CHECK_EQUAL(shared.command, NetMsgType::PING);
+    BOOST_REQUIRE_EQUAL(shared.wire.size(), CMessageHeader::HEADER_SIZE + payload.size());
+
+    // The header is the one PushMessage would send, followed by the payload.
+    CDataStream stream(std::vector<unsigned char>(shared.wire.begin(), shared.wire.begin() + CMessageHeader::HEADER_SIZE), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    stream >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::PING);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, payload.size());
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    BOOST_CHECK(memcmp(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), shared.wire.begin() + CMessageHeader::HEADER_SIZE));
+}
+
+BOOST_AUTO_TEST_CASE(net_message_pool_reuse)
+{
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(), "", true);
+    CNetMessagePool pool;
+    std::vector<unsigned char> stream;
+    for (const uint64_t nonce : {uint64_t{1}, uint64_t{2}}) {
+        const CSharedNetMsg ping(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, nonce));
+        stream.insert(stream.end(), ping.wire.begin(), ping.wire.end());
+    }
+    const CSharedNetMsg tx(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::TX, std::vector<unsigned char>(5000, 0x55)));
+    stream.insert(stream.end(), tx.wire.begin(), tx.wire.end());
+
+    for (int round = 0; round < 2; ++round) {
+        bool complete;
+        BOOST_REQUIRE(node.ReceiveMsgBytes((const char*)stream.data(), stream.size(), complete, &pool));
+        BOOST_CHECK(complete);
+        std::list<CNetMessage> msgs;
+        node.PopCompleteMessages(msgs);
+        BOOST_REQUIRE_EQUAL(msgs.size(), 3U);
+        // Messages taken from the pool are received like new ones
+        uint64_t nonce = 0;
+        auto it = msgs.begin();
+        BOOST_CHECK_EQUAL(it->hdr.GetCommand(), NetMsgType::PING);
+        it->vRecv >> nonce;
+        BOOST_CHECK_EQUAL(nonce, 1U);
+        BOOST_CHECK_EQUAL((++it)->hdr.GetCommand(), NetMsgType::PING);
+        it->vRecv >> nonce;
+        BOOST_CHECK_EQUAL(nonce, 2U);
+        BOOST_CHECK_EQUAL((++it)->hdr.GetCommand(), NetMsgType::TX);
+        BOOST_CHECK_EQUAL(it->vRecv.size(), 5000U + 3);
+        BOOST_CHECK(it->GetMessageHash() == Hash(tx.wire.begin() + CMessageHeader::HEADER_SIZE, tx.wire.end()));
+
+        // All of their memory goes back to the pool
+        pool.Recycle(msgs);
+        BOOST_CHECK(msgs.empty());
+        BOOST_CHECK_EQUAL(pool.GetMessageCount(), 3U);
+        BOOST_CHECK_EQUAL(pool.GetBufferCount(0), 2U);
+        BOOST_CHECK_EQUAL(pool.GetBufferCount(1), 1U);
+    }
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -137,4 +137,48 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Test that the cached, sliding LWMA window agrees with a full recomputation */
+BOOST_AUTO_TEST_CASE(lwma_cached_window)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    for (bool limit_st : {true, false}) {
+        Consensus::Params params = chainParams->GetConsensus();
+        params.bZawyLwmaSolvetimeLimitation = limit_st;
+        const int64_t T = params.nPowTargetSpacing;
+
+        // A main chain plus a side branch forking off halfway, with erratic
+        // (including negative) solvetimes and varying targets.
+        std::vector<CBlockIndex> blocks(2000);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            CBlockIndex* pprev = nullptr;
+            if (i == 1000) {
+                pprev = &blocks[500];
+            } else if (i > 0) {
+                pprev = &blocks[i - 1];
+            }
+            blocks[i].pprev = pprev;
+            blocks[i].nHeight = pprev ? pprev->nHeight + 1 : 0;
+            blocks[i].nTime = pprev ? pprev->nTime - T + InsecureRandRange(10 * T) : 1269211443;
+            blocks[i].nBits = 0x1c000001 + InsecureRandRange(0x007fffff);
+            blocks[i].BuildSkip();
+        }
+
+        // Query in a random order so that both the from-scratch and the
+        // sliding code paths get exercised.
+        std::vector<size_t> order(blocks.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        Shuffle(order.begin(), order.end(), g_insecure_rand_ctx);
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i : order) {
+                const CBlockIndex* pindex = &blocks[i];
+                if (pindex->nHeight < params.nZawyLwmaAveragingWindow) continue;
+                BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(pindex, params), LwmaCalculateNextWorkRequiredUncached(pindex, params));
+            }
+            // Then once more in chain order, starting from an empty cache.
+            for (auto& block : blocks) block.lwmaWindow.reset();
+            std::sort(order.begin(), order.end());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
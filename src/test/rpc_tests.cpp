@@ -7,11 +7,16 @@
 #include <rpc/client.h>
 #include <rpc/util.h>
 
+#include <chainparams.h>
 #include <core_io.h>
 #include <init.h>
 #include <interfaces/chain.h>
+#include <streams.h>
 #include <test/setup_common.h>
+#include <util/strencodings.h>
+#include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -418,4 +423,60 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+static std::string CallRPCError(const std::string& args)
+{
+    try {
+        CallRPC(args);
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_getblock_raw, TestChain100Setup)
+{
+    CBlockIndex* pindex = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    const std::string hash = pindex->GetBlockHash().GetHex();
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+
+    // With witness serialization the stored bytes are returned as is, and
+    // must match the block serialized again.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK_EQUAL(CallRPC("getblock " + hash + " 0").get_str(), HexStr(ss.begin(), ss.end()));
+
+    gArgs.ForceSetArg("-rpcserialversion", "0");
+    CDataStream ss_stripped(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss_stripped << block;
+    BOOST_CHECK_EQUAL(CallRPC("getblock " + hash + " 0").get_str(), HexStr(ss_stripped.begin(), ss_stripped.end()));
+    gArgs.ClearForcedArg("-rpcserialversion");
+
+    // A block file that is missing.
+    const int file = pindex->nFile;
+    WITH_LOCK(cs_main, pindex->nFile = 99999);
+    BOOST_CHECK_EQUAL(CallRPCError("getblock " + hash + " 0"), "Block not found on disk");
+    WITH_LOCK(cs_main, pindex->nFile = file);
+
+    // A block position that holds another block.
+    const unsigned int data_pos = pindex->nDataPos;
+    WITH_LOCK(cs_main, pindex->nDataPos = pindex->pprev->nDataPos);
+    BOOST_CHECK_EQUAL(CallRPCError("getblock " + hash + " 0"), "Block not found on disk");
+    WITH_LOCK(cs_main, pindex->nDataPos = data_pos);
+
+    // A pruned block.
+    {
+        LOCK(cs_main);
+        fHavePruned = true;
+        pindex->nStatus &= ~BLOCK_HAVE_DATA;
+    }
+    BOOST_CHECK_EQUAL(CallRPCError("getblock " + hash + " 0"), "Block not available (pruned data)");
+    {
+        LOCK(cs_main);
+        fHavePruned = false;
+        pindex->nStatus |= BLOCK_HAVE_DATA;
+    }
+    BOOST_CHECK_EQUAL(CallRPC("getblock " + hash + " 0").get_str(), HexStr(ss.begin(), ss.end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
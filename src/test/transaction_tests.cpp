@@ -283,6 +283,35 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(CTransaction(tx), state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(make_transaction_refs)
+{
+    // Transactions of different sizes, every third one with a witness
+    std::vector<CMutableTransaction> txs(30);
+    for (size_t i = 0; i < txs.size(); i++) {
+        txs[i].nVersion = 2;
+        txs[i].nLockTime = i;
+        txs[i].vin.resize(1 + i % 4);
+        for (CTxIn& txin : txs[i].vin) {
+            txin.prevout = COutPoint(InsecureRand256(), InsecureRand32());
+            txin.scriptSig = CScript() << std::vector<unsigned char>(i * 7, 0x01);
+            if (i % 3 == 0) txin.scriptWitness.stack.push_back(std::vector<unsigned char>(i * 5, 0x42));
+        }
+        txs[i].vout.resize(1 + i % 3);
+    }
+    const std::vector<CMutableTransaction> copies = txs;
+
+    const std::vector<CTransactionRef> refs = MakeTransactionRefs(std::move(txs));
+    BOOST_CHECK_EQUAL(refs.size(), copies.size());
+    for (size_t i = 0; i < refs.size(); i++) {
+        const CTransaction expected(copies[i]);
+        BOOST_CHECK(refs[i]->GetHash() == expected.GetHash());
+        BOOST_CHECK(refs[i]->GetWitnessHash() == expected.GetWitnessHash());
+        BOOST_CHECK(refs[i]->vin == expected.vin);
+        BOOST_CHECK(refs[i]->vout == expected.vout);
+        BOOST_CHECK_EQUAL(refs[i]->HasWitness(), i % 3 == 0);
+    }
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <key.h>
 #include <validation.h>
@@ -15,6 +16,7 @@
 #include <boost/test/unit_test.hpp>
 
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks);
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
 
 BOOST_AUTO_TEST_SUITE(tx_validationcache_tests)
 
@@ -374,4 +376,85 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+static CMutableTransaction CreateSpend(const COutPoint& prevout, const CAmount& prev_value, const CKey& key, const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev_value - CENT;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, prev_value, SigVersion::BASE, true);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL));
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(preverify_block_scripts, TestChain100Setup)
+{
+    // Blocks stored ahead of the tip get their scripts verified into the
+    // script execution cache, so that connecting them later skips the checks.
+    CScript p2pk_scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A chain of two spends, the second one spending an output of the block
+    // itself, and a spend of an output nobody knows about.
+    CMutableTransaction spend1 = CreateSpend(COutPoint(m_coinbase_txns[0]->GetHash(), 0), m_coinbase_txns[0]->vout[0].nValue, coinbaseKey, p2pk_scriptPubKey);
+    CMutableTransaction spend2 = CreateSpend(COutPoint(spend1.GetHash(), 0), spend1.vout[0].nValue, coinbaseKey, p2pk_scriptPubKey);
+    CMutableTransaction spend_unknown = CreateSpend(COutPoint(InsecureRand256(), 0), 50 * COIN, coinbaseKey, p2pk_scriptPubKey);
+    // A spend whose signature does not commit to its output
+    CMutableTransaction spend_invalid = CreateSpend(COutPoint(m_coinbase_txns[1]->GetHash(), 0), m_coinbase_txns[1]->vout[0].nValue, coinbaseKey, p2pk_scriptPubKey);
+    spend_invalid.vout[0].nValue -= CENT;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = p2pk_scriptPubKey;
+
+    auto block = std::make_shared<CBlock>();
+    block->vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(spend1), MakeTransactionRef(spend2), MakeTransactionRef(spend_unknown)};
+    auto block_invalid = std::make_shared<CBlock>();
+    block_invalid->vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(spend_invalid)};
+
+    CBlockIndex index;
+    unsigned int flags;
+    {
+        LOCK(cs_main);
+        InitScriptExecutionCache();
+        index.pprev = ::ChainActive().Tip();
+        index.nHeight = index.pprev->nHeight + 1;
+        flags = GetBlockScriptFlags(&index, Params().GetConsensus());
+        // Only prevouts in the coins cache are used
+        ::ChainstateActive().CoinsTip().AccessCoin(spend1.vin[0].prevout);
+        ::ChainstateActive().CoinsTip().AccessCoin(spend_invalid.vin[0].prevout);
+    }
+
+    BOOST_CHECK_EQUAL(PreverifyBlockScripts(*block, &index), 2U);
+    BOOST_CHECK_EQUAL(PreverifyBlockScripts(*block_invalid, &index), 0U);
+    // Nothing left to do the second time
+    BOOST_CHECK_EQUAL(PreverifyBlockScripts(*block, &index), 0U);
+    // The outputs of preverified blocks stay known after the blocks are gone
+    CMutableTransaction spend3 = CreateSpend(COutPoint(spend2.GetHash(), 0), spend2.vout[0].nValue, coinbaseKey, p2pk_scriptPubKey);
+    CBlock block_next;
+    block_next.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(spend3)};
+    block.reset();
+    BOOST_CHECK_EQUAL(PreverifyBlockScripts(block_next, &index), 1U);
+
+    LOCK(cs_main);
+    CCoinsViewCache view(&::ChainstateActive().CoinsTip());
+    AddCoins(view, CTransaction(spend1), index.nHeight);
+    for (const CMutableTransaction& tx : {spend1, spend2, spend_invalid}) {
+        CValidationState state;
+        const CTransaction ctx(tx);
+        PrecomputedTransactionData txdata(ctx);
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputs(ctx, state, view, flags, false, false, txdata, &scriptchecks));
+        BOOST_CHECK_EQUAL(scriptchecks.size(), tx.GetHash() == spend_invalid.GetHash() ? 1U : 0U);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -335,4 +335,42 @@ BOOST_AUTO_TEST_CASE(mempool_locks_reorg)
         rpc_thread.join();
     }
 }
+
+BOOST_AUTO_TEST_CASE(processnewblockheaders_parallel_precheck)
+{
+    // Enough headers for the proof of work prechecks to be split over threads.
+    // Restore the global even if a BOOST_REQUIRE below ends the test early.
+    struct ThreadsRestorer {
+        const int saved = nScriptCheckThreads;
+        ~ThreadsRestorer() { nScriptCheckThreads = saved; }
+    } restore_threads;
+    nScriptCheckThreads = 4;
+
+    std::vector<CBlockHeader> headers;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 1200; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = prev_hash;
+        header.nTime = Params().GenesisBlock().nTime + i + 1;
+        header.nBits = Params().GenesisBlock().nBits;
+        // Every header has a valid proof of work except the one at index 900
+        while (CheckProofOfWork(header.GetHash(), header.nBits, Params().GetConsensus()) == (i == 900)) {
+            ++header.nNonce;
+        }
+        headers.push_back(header);
+        prev_hash = header.GetHash();
+    }
+
+    CValidationState state;
+    const CBlockIndex* tip = nullptr;
+    CBlockHeader first_invalid;
+    BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params(), &tip, &first_invalid));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK(first_invalid.GetHash() == headers[900].GetHash());
+    BOOST_REQUIRE(tip != nullptr);
+    BOOST_CHECK(tip->GetBlockHash() == headers[899].GetHash());
+    BOOST_CHECK_EQUAL(tip->nHeight, 900);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -80,7 +80,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -116,7 +116,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -168,13 +168,113 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+CCoinsViewAsyncFlush::~CCoinsViewAsyncFlush()
+{
+    if (m_thread.joinable()) m_thread.join();
+}
+
+bool CCoinsViewAsyncFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    const std::shared_ptr<const CCoinsMap> pending = WITH_LOCK(m_mutex, return m_pending);
+    if (pending) {
+        CCoinsMap::const_iterator it = pending->find(outpoint);
+        if (it != pending->end()) {
+            if (it->second.coin.IsSpent()) return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    // Not part of the batch in flight, so the database is up to date for it.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewAsyncFlush::HaveCoin(const COutPoint &outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewAsyncFlush::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) return m_pending_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncFlush::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase)
+{
+    if (!WaitForFlush()) return false;
+
+    std::shared_ptr<CCoinsMap> batch = std::make_shared<CCoinsMap>();
+    size_t usage = 0;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+        // Ignore non-dirty entries (optimization).
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            continue;
+        }
+        CCoinsCacheEntry& entry = (*batch)[it->first];
+        entry.coin = erase ? std::move(it->second.coin) : it->second.coin;
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        usage += entry.coin.DynamicMemoryUsage();
+    }
+    {
+        LOCK(m_mutex);
+        m_pending = batch;
+        m_pending_block = hashBlock;
+        m_pending_usage = usage + memusage::DynamicUsage(*batch);
+    }
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "coinsflush",
+        std::bind(&CCoinsViewAsyncFlush::ThreadFlush, this, std::move(batch), hashBlock));
+    return true;
+}
+
+void CCoinsViewAsyncFlush::ThreadFlush(std::shared_ptr<CCoinsMap> batch, const uint256& hashBlock)
+{
+    bool ok = false;
+    try {
+        // Keep the entries in place: readers may still be looking them up.
+        ok = base->BatchWrite(*batch, hashBlock, /* erase */ false);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (!ok) {
+        // Keep serving the batch, the node is going to shut down.
+        WITH_LOCK(m_mutex, m_failed = true);
+        m_on_failure("Failed to write to coin database");
+        return;
+    }
+    LOCK(m_mutex);
+    m_pending.reset();
+    m_pending_usage = 0;
+}
+
+bool CCoinsViewAsyncFlush::WaitForFlush()
+{
+    if (m_thread.joinable()) m_thread.join();
+    LOCK(m_mutex);
+    return !m_failed;
+}
+
+size_t CCoinsViewAsyncFlush::DynamicMemoryUsage() const
+{
+    LOCK(m_mutex);
+    return m_pending_usage;
+}
+
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
+{
+    return Cursor(uint256());
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const uint256& start_txid) const
 {
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    i->pcursor->Seek(std::make_pair(DB_COIN, start_txid));
     // Cache key of first record
     if (i->pcursor->Valid()) {
         CoinEntry entry(&i->keyTmp.second);
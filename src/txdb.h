@@ -11,10 +11,13 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -26,6 +29,10 @@ class uint256;
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
+//! -dbcacheretain default (percent of the UTXO cache budget kept warm when the cache fills up)
+static const int64_t nDefaultDbCacheRetain = 75;
+//! max. -dbcacheretain (percent)
+static const int64_t nMaxDbCacheRetain = 90;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
 //! max. -dbcache (MiB)
@@ -58,14 +65,66 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Like Cursor(), but starting at the first coin whose txid is not below start_txid in key order.
+    CCoinsViewCursor *Cursor(const uint256& start_txid) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 };
 
+/**
+ * CCoinsView that commits the batches written to it to its base, the coin
+ * database, on a background thread.
+ *
+ * BatchWrite() moves (or, if erase is false, copies) the dirty entries into
+ * an immutable pending batch and returns right away, so that validation can
+ * continue on the emptied (or synced) cache above. Until the batch is
+ * committed, reads are answered from it before falling through to the
+ * database. At most one batch is in flight: the next BatchWrite() waits for
+ * the previous one, and DynamicMemoryUsage() reports the memory held by it so
+ * that it can be counted against the cache budget. While a batch is being
+ * written the database carries the usual head blocks marker, so a crash in
+ * the middle is recovered by ReplayBlocks() like before. If writing a batch
+ * fails, on_failure is called from the flush thread right away.
+ *
+ * BatchWrite() and WaitForFlush() must not be called concurrently; the
+ * chainstate calls them with cs_main held.
+ */
+class CCoinsViewAsyncFlush final : public CCoinsViewBacked
+{
+public:
+    CCoinsViewAsyncFlush(CCoinsView* view, std::function<void(const std::string&)> on_failure)
+        : CCoinsViewBacked(view), m_on_failure(std::move(on_failure)) {}
+    ~CCoinsViewAsyncFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
+
+    //! Wait until the batch in flight, if any, is committed. Returns false if
+    //! committing it, or an earlier batch, failed.
+    bool WaitForFlush();
+
+    //! Memory used by the batch in flight, if any.
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void ThreadFlush(std::shared_ptr<CCoinsMap> batch, const uint256& hashBlock);
+
+    mutable Mutex m_mutex;
+    //! The batch being committed, not modified once handed to the thread.
+    std::shared_ptr<const CCoinsMap> m_pending GUARDED_BY(m_mutex);
+    uint256 m_pending_block GUARDED_BY(m_mutex);
+    size_t m_pending_usage GUARDED_BY(m_mutex){0};
+    bool m_failed GUARDED_BY(m_mutex){false};
+    const std::function<void(const std::string&)> m_on_failure;
+    std::thread m_thread;
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -791,6 +791,25 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoSorted(const std::vector<uint256>& hashes) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(hashes.size());
+    for (const uint256& hash : hashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end()) iters.push_back(i);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -693,6 +693,8 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Info about those of hashes in the mempool, in the order of CompareDepthAndScore. */
+    std::vector<TxMempoolInfo> infoSorted(const std::vector<uint256>& hashes) const;
 
     size_t DynamicMemoryUsage() const;
 
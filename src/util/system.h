@@ -265,6 +265,9 @@ public:
     // been set. Also called directly in testing.
     void ForceSetArg(const std::string& strArg, const std::string& strValue);
 
+    // Removes an arg setting made by ForceSetArg(). Used in testing.
+    void ClearForcedArg(const std::string& strArg);
+
     /**
      * Looks for -regtest, -testnet and returns the appropriate BIP70 chain name.
      * @return CBaseChainParams::MAIN by default; raises runtime error if an invalid combination is given.
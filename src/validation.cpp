@@ -10,11 +10,14 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkqueue.h>
+#include <clientversion.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -47,9 +50,13 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
 #include <future>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -112,6 +119,7 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 int nScriptCheckThreads = 0;
+int nCoinsPrefetchThreads = DEFAULT_COINS_PREFETCH_THREADS;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -189,6 +197,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+static bool AbortNode(const std::string& strMessage, const std::string& userMessage = "", unsigned int prefix = 0);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -313,7 +322,7 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
 }
 
 // Returns the script flags which should be checked for a given block
-static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
     EXCLUSIVE_LOCKS_REQUIRED(pool.cs, ::cs_main)
@@ -1175,10 +1184,69 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     return true;
 }
 
+static std::unique_ptr<FlatFileMapCache> g_block_file_maps;
+
+void InitBlockFileMapCache(size_t max_files)
+{
+    if (max_files == 0) {
+        g_block_file_maps.reset();
+        return;
+    }
+    g_block_file_maps = MakeUnique<FlatFileMapCache>(BlockFileSeq(), max_files);
+}
+
+/**
+ * Find the block stored at pos in the memory mapped block files. On success,
+ * record_out spans the 8 byte meta header (message start and size) followed by
+ * the serialized block, and the returned mapping must be kept alive while it
+ * is used. Returns nullptr if block files are not mapped or the record cannot
+ * be located, in which case the caller reads through the file instead.
+ */
+static std::shared_ptr<const MappedFlatFile> GetMappedBlockRecord(const FlatFilePos& pos, Span<const unsigned char>& record_out)
+{
+    if (!g_block_file_maps || pos.IsNull() || pos.nPos < 8) {
+        return nullptr;
+    }
+    std::shared_ptr<const MappedFlatFile> mapped = g_block_file_maps->Get(pos.nFile, pos.nPos);
+    if (!mapped) {
+        return nullptr;
+    }
+    Span<const unsigned char> meta = mapped->Range(pos.nPos - 8, 8);
+    if (meta.size() != 8) {
+        return nullptr;
+    }
+    const unsigned int blk_size = ReadLE32(meta.data() + CMessageHeader::MESSAGE_START_SIZE);
+    if (blk_size == 0 || blk_size > MAX_SIZE) {
+        return nullptr;
+    }
+    if (mapped->size() < pos.nPos + (size_t)blk_size) {
+        // The block was appended after the file was mapped.
+        mapped = g_block_file_maps->Get(pos.nFile, pos.nPos + (size_t)blk_size);
+        if (!mapped) {
+            return nullptr;
+        }
+    }
+    record_out = mapped->Range(pos.nPos - 8, 8 + (size_t)blk_size);
+    return mapped;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const MappedFlatFile> mapped = GetMappedBlockRecord(pos, record)) {
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, record.subspan(8)) >> block;
+            if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+                return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
+            return true;
+        } catch (const std::exception& e) {
+            // Retry through the file below, which reports the error.
+            block.SetNull();
+        }
+    }
+
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -1217,6 +1285,15 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const MappedFlatFile> mapped = GetMappedBlockRecord(pos, record)) {
+        if (memcmp(record.data(), message_start, CMessageHeader::MESSAGE_START_SIZE) == 0) {
+            block.assign(record.begin() + 8, record.end());
+            return true;
+        }
+        // Let the regular path below report the magic mismatch.
+    }
+
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1258,7 +1335,20 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
         block_pos = pindex->GetBlockPos();
     }
 
-    return ReadRawBlockFromDisk(block, block_pos, message_start);
+    if (!ReadRawBlockFromDisk(block, block_pos, message_start))
+        return false;
+    // The bytes are served without being deserialized, so at least make sure
+    // they belong to the requested block.
+    CBlockHeader header;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0) >> header;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s for %s", __func__, e.what(), pindex->ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(std::vector<uint8_t>&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), block_pos.ToString());
+    return true;
 }
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
@@ -1280,7 +1370,8 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_asyncview(&m_dbview, [](const std::string& msg) { AbortNode(msg); }),
+                        m_catcherview(&m_asyncview) {}
 
 void CoinsViews::InitCache()
 {
@@ -1509,6 +1600,17 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/** The script execution cache entry for the scripts of tx checked with the given flags. */
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1539,11 +1641,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    // We only use the first 19 bytes of nonce to avoid a second SHA
-    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    const uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
     AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
@@ -1661,7 +1759,7 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 }
 
 /** Abort with a message */
-static bool AbortNode(const std::string& strMessage, const std::string& userMessage = "", unsigned int prefix = 0)
+static bool AbortNode(const std::string& strMessage, const std::string& userMessage, unsigned int prefix)
 {
     SetMiscWarning(strMessage);
     LogPrintf("*** %s\n", strMessage);
@@ -1869,7 +1967,8 @@ static bool IsScriptWitnessEnabled(const Consensus::Params& params)
     return params.SegwitHeight != std::numeric_limits<int>::max();
 }
 
-static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+// Non-static (and re-declared) in src/test/txvalidationcache_tests.cpp
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     AssertLockHeld(cs_main);
 
     unsigned int flags = SCRIPT_VERIFY_NONE;
@@ -1922,6 +2021,296 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
     return flags;
 }
 
+/**
+ * Whether the scripts of a block can be assumed valid because it is an
+ * ancestor of the -assumevalid block on the best header chain.
+ */
+static bool IsScriptAssumedValid(const CBlockIndex* pindex, const BlockMap& block_index, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (hashAssumeValid.IsNull()) return false;
+
+    // We've been configured with the hash of a block which has been externally verified to have a valid history.
+    // A suitable default value is included with the software and updated from time to time.  Because validity
+    //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+    // This setting doesn't force the selection of any particular chain but makes validating some faster by
+    //  effectively caching the result of part of the verification.
+    BlockMap::const_iterator  it = block_index.find(hashAssumeValid);
+    if (it == block_index.end()) return false;
+    if (it->second->GetAncestor(pindex->nHeight) != pindex ||
+        pindexBestHeader->GetAncestor(pindex->nHeight) != pindex ||
+        pindexBestHeader->nChainWork < nMinimumChainWork) {
+        return false;
+    }
+    // This block is a member of the assumed verified chain and an ancestor of the best header.
+    // Script verification is skipped when connecting blocks under the
+    // assumevalid block. Assuming the assumevalid block is valid this
+    // is safe because block merkle hashes are still computed and checked,
+    // Of course, if an assumed valid block is invalid due to false scriptSigs
+    // this optimization would allow an invalid chain to be accepted.
+    // The equivalent time check discourages hash power from extorting the network via DOS attack
+    //  into accepting an invalid block through telling users they must manually set assumevalid.
+    //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+    //  it hard to hide the implication of the demand.  This also avoids having release candidates
+    //  that are hardly doing any signature verification at all in testing without having to
+    //  artificially set the default assumed verified block further back.
+    // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+    //  least as good as the expected chain.
+    return GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusparams) > 60 * 60 * 24 * 7 * 2;
+}
+
+/** Maximum number of blocks waiting for script preverification; the highest ones are dropped first. */
+static constexpr size_t MAX_PREVERIFY_QUEUED_BLOCKS = 64;
+/** Maximum memory used by the waiting blocks that are kept in memory; the others are read back from disk. */
+static constexpr size_t MAX_PREVERIFY_QUEUED_MEMORY = 32 * 1024 * 1024;
+/** Number of preverified blocks whose outputs can be spent by the blocks preverified after them. */
+static constexpr size_t PREVERIFY_OUTPUT_WINDOW = 16;
+/** Number of script checks handed to the script check queue at once during preverification. */
+static constexpr size_t PREVERIFY_CHECKS_PER_BATCH = 256;
+
+/**
+ * Verifies the scripts of blocks that were stored ahead of the active chain
+ * tip, while they wait for the blocks before them, and records the transactions
+ * that passed in the script execution cache. ConnectBlock then finds them there
+ * and skips their script checks. Blocks under the -assumevalid block are not
+ * queued, as their scripts are not checked anyway. Waiting blocks are kept in
+ * memory up to MAX_PREVERIFY_QUEUED_MEMORY, so that they are not read from disk
+ * an extra time; beyond that only their index entries are queued and they are
+ * read back when their turn comes. Only the outputs of the preverified blocks
+ * are kept afterwards.
+ *
+ * Only prevouts that are already in the coins tip cache, or that are created by
+ * the block itself or by one of the last PREVERIFY_OUTPUT_WINDOW preverified
+ * blocks, are used; transactions with other inputs are left to ConnectBlock.
+ * This is safe regardless of whether the block turns out to be valid: a cache
+ * entry only states that the scripts of a transaction pass with the given flags
+ * against the outputs its prevouts commit to, the same assumption CheckInputs
+ * makes for cache entries added from the mempool.
+ */
+class CScriptPreverifier
+{
+public:
+    void Start();
+    void Stop();
+
+    //! Queue a block that was just stored, if it cannot be connected right away.
+    void BlockAccepted(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    //! Verify the scripts of a block now. Not to be called concurrently.
+    size_t Preverify(const CBlock& block, const CBlockIndex* pindex) LOCKS_EXCLUDED(cs_main);
+
+private:
+    void ThreadPreverify();
+    void AddOutputs(const CBlock& block);
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    struct QueuedBlock {
+        const CBlockIndex* pindex;
+        //! The block itself, or null if it is to be read from disk
+        std::shared_ptr<const CBlock> block;
+        size_t usage;
+    };
+
+    //! Stored blocks waiting for preverification, by height
+    std::multimap<int, QueuedBlock> m_queue GUARDED_BY(m_mutex);
+    //! Memory used by the blocks in m_queue
+    size_t m_queue_usage GUARDED_BY(m_mutex){0};
+    bool m_running GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    //! For each of the last preverified blocks, the outputs it added to
+    //! m_outputs; both only used by Preverify()
+    std::deque<std::vector<COutPoint>> m_window;
+    std::unordered_map<COutPoint, CTxOut, SaltedOutpointHasher> m_outputs;
+};
+
+static CScriptPreverifier g_script_preverifier;
+
+void CScriptPreverifier::Start()
+{
+    LOCK(m_mutex);
+    m_running = true;
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "preverify", std::bind(&CScriptPreverifier::ThreadPreverify, this));
+}
+
+void CScriptPreverifier::Stop()
+{
+    {
+        LOCK(m_mutex);
+        m_running = false;
+        m_queue.clear();
+        m_queue_usage = 0;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void CScriptPreverifier::BlockAccepted(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& block)
+{
+    AssertLockHeld(cs_main);
+    // The block after the tip is connected right away, so only blocks that wait
+    // for others are worth a head start.
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    if (tip == nullptr || pindex->nHeight <= tip->nHeight + 1 || pindex->nChainWork <= tip->nChainWork) return;
+    // ConnectBlock will not check these scripts either.
+    if (IsScriptAssumedValid(pindex, ::BlockIndex(), Params().GetConsensus())) return;
+
+    const size_t usage = RecursiveDynamicUsage(block);
+    LOCK(m_mutex);
+    if (!m_running) return;
+    if (m_queue_usage + usage <= MAX_PREVERIFY_QUEUED_MEMORY) {
+        m_queue.emplace(pindex->nHeight, QueuedBlock{pindex, block, usage});
+        m_queue_usage += usage;
+    } else {
+        m_queue.emplace(pindex->nHeight, QueuedBlock{pindex, nullptr, 0});
+    }
+    if (m_queue.size() > MAX_PREVERIFY_QUEUED_BLOCKS) {
+        m_queue_usage -= std::prev(m_queue.end())->second.usage;
+        m_queue.erase(std::prev(m_queue.end()));
+    }
+    m_cv.notify_one();
+}
+
+void CScriptPreverifier::ThreadPreverify()
+{
+    while (true) {
+        QueuedBlock queued;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_running || !m_queue.empty(); });
+            if (!m_running) return;
+            // Lowest first, so that the outputs of earlier blocks are known.
+            queued = std::move(m_queue.begin()->second);
+            m_queue_usage -= queued.usage;
+            m_queue.erase(m_queue.begin());
+        }
+        const CBlockIndex* pindex = queued.pindex;
+        {
+            LOCK(cs_main);
+            // Connected (or pruned) in the meantime.
+            if (::ChainActive().Height() >= pindex->nHeight) continue;
+            if (!queued.block && !(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+        }
+        const int64_t nTimeStart = GetTimeMicros();
+        if (!queued.block) {
+            std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*block, pindex, Params().GetConsensus())) continue;
+            queued.block = std::move(block);
+        }
+        const size_t n_cached = Preverify(*queued.block, pindex);
+        LogPrint(BCLog::BENCH, "Preverified scripts of %u/%u transactions in block %s (height %d): %.2fms\n",
+            n_cached, queued.block->vtx.size(), pindex->GetBlockHash().ToString(), pindex->nHeight, (GetTimeMicros() - nTimeStart) * MILLI);
+    }
+}
+
+void CScriptPreverifier::AddOutputs(const CBlock& block)
+{
+    // Keep a copy of the outputs only, not the block. Should another block
+    // in the window have created the same output first, that one stays.
+    m_window.emplace_back();
+    for (const auto& tx : block.vtx) {
+        for (size_t i = 0; i < tx->vout.size(); i++) {
+            const COutPoint outpoint(tx->GetHash(), i);
+            if (m_outputs.emplace(outpoint, tx->vout[i]).second) m_window.back().push_back(outpoint);
+        }
+    }
+    if (m_window.size() <= PREVERIFY_OUTPUT_WINDOW) return;
+
+    // Forget the oldest block.
+    for (const COutPoint& outpoint : m_window.front()) {
+        m_outputs.erase(outpoint);
+    }
+    m_window.pop_front();
+}
+
+size_t CScriptPreverifier::Preverify(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Transactions whose spent outputs are all known, with those outputs
+    std::vector<std::pair<const CTransaction*, std::vector<CTxOut>>> txs;
+    unsigned int flags;
+    {
+        LOCK(cs_main);
+        // ConnectBlock got there first.
+        if (::ChainActive().Height() >= pindex->nHeight) return 0;
+
+        AddOutputs(block);
+        flags = GetBlockScriptFlags(pindex, Params().GetConsensus());
+        const CCoinsViewCache& coins = ::ChainstateActive().CoinsTip();
+        for (const auto& tx : block.vtx) {
+            if (tx->IsCoinBase() || scriptExecutionCache.contains(GetScriptExecutionCacheEntry(*tx, flags), false)) continue;
+            std::vector<CTxOut> spent;
+            spent.reserve(tx->vin.size());
+            for (const CTxIn& txin : tx->vin) {
+                auto it = m_outputs.find(txin.prevout);
+                if (it != m_outputs.end()) {
+                    spent.push_back(it->second);
+                } else if (coins.HaveCoinInCache(txin.prevout)) {
+                    spent.push_back(coins.AccessCoin(txin.prevout).out);
+                } else {
+                    break;
+                }
+            }
+            if (spent.size() == tx->vin.size()) txs.emplace_back(tx.get(), std::move(spent));
+        }
+    }
+
+    // Run the checks in batches of whole transactions, so that one invalid
+    // transaction only costs the cache entries of its own batch, and
+    // ConnectBlock never waits long for the script check queue.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txs.size());
+    std::vector<uint256> verified;
+    size_t begin = 0;
+    while (begin < txs.size()) {
+        std::vector<CScriptCheck> checks;
+        size_t end = begin;
+        for (; end < txs.size() && checks.size() < PREVERIFY_CHECKS_PER_BATCH; end++) {
+            const CTransaction& tx = *txs[end].first;
+            txdata.emplace_back(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                checks.emplace_back(txs[end].second[i], tx, i, flags, false, &txdata.back());
+            }
+        }
+        bool ok;
+        if (nScriptCheckThreads) {
+            CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+            control.Add(checks);
+            ok = control.Wait();
+        } else {
+            ok = std::all_of(checks.begin(), checks.end(), [](CScriptCheck& check) { return check(); });
+        }
+        if (ok) {
+            for (size_t i = begin; i < end; i++) {
+                verified.push_back(GetScriptExecutionCacheEntry(*txs[i].first, flags));
+            }
+        }
+        begin = end;
+    }
+
+    if (!verified.empty()) {
+        LOCK(cs_main);
+        for (const uint256& entry : verified) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+    return verified.size();
+}
+
+void StartScriptPreverification()
+{
+    g_script_preverifier.Start();
+}
+
+void StopScriptPreverification()
+{
+    g_script_preverifier.Stop();
+}
+
+size_t PreverifyBlockScripts(const CBlock& block, const CBlockIndex* pindex)
+{
+    return g_script_preverifier.Preverify(block, pindex);
+}
+
 
 
 static int64_t nTimeCheck = 0;
@@ -1981,36 +2370,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     nBlocksTotal++;
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = m_blockman.m_block_index.find(hashAssumeValid);
-        if (it != m_blockman.m_block_index.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= nMinimumChainWork) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // Script verification is skipped when connecting blocks under the
-                // assumevalid block. Assuming the assumevalid block is valid this
-                // is safe because block merkle hashes are still computed and checked,
-                // Of course, if an assumed valid block is invalid due to false scriptSigs
-                // this optimization would allow an invalid chain to be accepted.
-                // The equivalent time check discourages hash power from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
+    bool fScriptChecks = !IsScriptAssumedValid(pindex, m_blockman.m_block_index, chainparams.GetConsensus());
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
@@ -2290,7 +2650,8 @@ bool CChainState::FlushStateToDisk(
             nLastFlush = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+        // Coins still being written in the background count against the budget too.
+        int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + m_coins_views->m_asyncview.DynamicMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2328,9 +2689,13 @@ bool CChainState::FlushStateToDisk(
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, once the coin database has
+            // caught up with the last chainstate flush.
+            if (fFlushForPrune) {
+                if (!m_coins_views->m_asyncview.WaitForFlush())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2344,11 +2709,28 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // Unless disabled, the cache stays warm: written entries remain
+            // cached, and only when the cache ran full is it trimmed down to
+            // the retained share of its budget.
+            const int64_t retain_percent = std::min(gArgs.GetArg("-dbcacheretain", nDefaultDbCacheRetain), nMaxDbCacheRetain);
+            bool flushed;
+            if (retain_percent <= 0) {
+                flushed = CoinsTip().Flush();
+            } else if (fCacheLarge || fCacheCritical) {
+                flushed = CoinsTip().Sync(nTotalSpace / 100 * retain_percent);
+            } else {
+                flushed = CoinsTip().Sync();
+            }
+            if (!flushed)
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
         }
+        // The coins are written to the database in the background. Callers
+        // asking for a full flush expect to find them there afterwards.
+        if (mode == FlushStateMode::ALWAYS && !m_coins_views->m_asyncview.WaitForFlush()) {
+            return AbortNode(state, "Failed to write to coin database");
+        }
     }
     if (full_flush_completed) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2502,6 +2884,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2569,6 +2952,76 @@ public:
     }
 };
 
+/** Minimum number of inputs handed to each thread when prefetching the coins spent by a block. */
+static constexpr size_t MIN_INPUTS_PER_PREFETCH_THREAD = 16;
+
+/**
+ * Read the coins spent by a block that are not in the coins tip cache from the
+ * chainstate database on up to nCoinsPrefetchThreads threads, and add them to
+ * the cache before ConnectBlock runs. Otherwise every cache miss in
+ * ConnectBlock is a synchronous database read. This is only an optimization:
+ * inputs that were not prefetched, including those whose read failed, are
+ * fetched through the cache as before.
+ *
+ * Returns the number of coins added to the cache.
+ */
+static size_t PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& db)
+{
+    if (nCoinsPrefetchThreads <= 0) return 0;
+
+    // Outputs created by the block itself are not in the database yet.
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    block_txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+
+    std::vector<COutPoint> misses;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (block_txids.count(txin.prevout.hash) || cache.HaveCoinInCache(txin.prevout)) continue;
+            misses.push_back(txin.prevout);
+        }
+    }
+
+    const size_t n_jobs = std::min<size_t>(nCoinsPrefetchThreads, misses.size() / MIN_INPUTS_PER_PREFETCH_THREAD);
+    if (n_jobs == 0) return 0;
+
+    std::vector<Coin> coins(misses.size());
+    std::vector<unsigned char> found(misses.size());
+    auto fetch_range = [&](size_t begin, size_t end) {
+        try {
+            for (size_t i = begin; i < end; i++) {
+                found[i] = db.GetCoin(misses[i], coins[i]);
+            }
+        } catch (const std::exception& e) {
+            // Leave the rest of the range to the regular fetch path, which
+            // handles database errors.
+            LogPrint(BCLog::BENCH, "%s: prefetch aborted: %s\n", __func__, e.what());
+        }
+    };
+
+    const size_t chunk = (misses.size() + n_jobs - 1) / n_jobs;
+    std::vector<std::thread> workers;
+    workers.reserve(n_jobs - 1);
+    for (size_t job = 1; job < n_jobs; job++) {
+        workers.emplace_back(fetch_range, job * chunk, std::min(misses.size(), (job + 1) * chunk));
+    }
+    fetch_range(0, chunk);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    size_t n_added = 0;
+    for (size_t i = 0; i < misses.size(); i++) {
+        if (!found[i]) continue;
+        cache.AddFetchedCoin(misses[i], std::move(coins[i]));
+        n_added++;
+    }
+    return n_added;
+}
+
 /**
  * Connect a new block to m_chain. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -2594,6 +3047,10 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    const size_t n_prefetched = PrefetchBlockInputs(blockConnecting, CoinsTip(), m_coins_views->m_asyncview);
+    int64_t nTime2p = GetTimeMicros(); nTimePrefetch += nTime2p - nTime2;
+    LogPrint(BCLog::BENCH, "  - Prefetch %u inputs: %.2fms [%.2fs]\n", n_prefetched, (nTime2p - nTime2) * MILLI, nTimePrefetch * MICRO);
+    nTime2 = nTime2p;
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -3140,11 +3597,15 @@ void ResetBlockFailureFlags(CBlockIndex *pindex) {
 }
 
 CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
+{
+    return AddToBlockIndex(block, block.GetHash());
+}
+
+CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = m_block_index.find(hash);
     if (it != m_block_index.end())
         return it->second;
@@ -3599,10 +4060,14 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
 }
 
 bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+{
+    return AcceptBlockHeader(block, block.GetHash(), true, state, chainparams, ppindex);
+}
+
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, bool fCheckPOW, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = m_block_index.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3616,7 +4081,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3669,7 +4134,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
         }
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3677,15 +4142,57 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
     return true;
 }
 
+/** Minimum number of headers handed to each thread when prechecking a headers batch. */
+static constexpr size_t MIN_HEADERS_PER_PRECHECK_THREAD = 250;
+
+/**
+ * Hash every header of a batch and check its proof of work. These checks need
+ * no context, so they run before cs_main is taken, and large batches are split
+ * over up to nScriptCheckThreads threads.
+ */
+static void PreCheckBlockHeaders(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, std::vector<uint256>& hashes, std::vector<unsigned char>& pow_valid)
+{
+    hashes.resize(headers.size());
+    pow_valid.resize(headers.size());
+    auto check_range = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            hashes[i] = headers[i].GetHash();
+            pow_valid[i] = CheckProofOfWork(hashes[i], headers[i].nBits, consensusParams);
+        }
+    };
+
+    const size_t n_jobs = std::min<size_t>(std::max(nScriptCheckThreads, 1), headers.size() / MIN_HEADERS_PER_PRECHECK_THREAD);
+    if (n_jobs <= 1) {
+        check_range(0, headers.size());
+        return;
+    }
+    const size_t chunk = (headers.size() + n_jobs - 1) / n_jobs;
+    std::vector<std::thread> workers;
+    workers.reserve(n_jobs - 1);
+    for (size_t job = 1; job < n_jobs; job++) {
+        workers.emplace_back(check_range, job * chunk, std::min(headers.size(), (job + 1) * chunk));
+    }
+    check_range(0, chunk);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    std::vector<uint256> hashes;
+    std::vector<unsigned char> pow_valid;
+    PreCheckBlockHeaders(headers, chainparams.GetConsensus(), hashes, pow_valid);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            // Headers that failed the precheck go through the full check again so
+            // they are rejected with the usual state and log message.
+            bool accepted = g_blockman.AcceptBlockHeader(header, hashes[i], !pow_valid[i], state, chainparams, &pindex);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3814,6 +4321,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
     {
         CBlockIndex *pindex = nullptr;
+        bool new_block = false;
         if (fNewBlock) *fNewBlock = false;
         CValidationState state;
 
@@ -3826,7 +4334,12 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
         if (ret) {
             // Store to disk
-            ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);
+            ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, &new_block);
+            if (fNewBlock) *fNewBlock = new_block;
+        }
+        if (ret && new_block) {
+            // Start on the scripts if the block has to wait for its predecessors
+            g_script_preverifier.BlockAccepted(pindex, pblock);
         }
         if (!ret) {
             GetMainSignals().BlockChecked(*pblock, state);
@@ -3923,6 +4436,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        if (g_block_file_maps) g_block_file_maps->Erase(*it);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -5121,6 +5635,127 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 2;
+
+//! Whether the script caches were set up from a snapshot (or there was none), so they may replace it
+static bool g_script_caches_loaded = false;
+
+bool LoadScriptCaches()
+{
+    // Even without a snapshot, the caches are worth dumping at shutdown.
+    g_script_caches_loaded = true;
+
+    const fs::path path = GetDataDir() / "sigcache.dat";
+    FILE* filestr = fsbridge::fopen(path, "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce;
+    std::vector<uint256> sig_entries;
+    uint256 script_nonce;
+    std::vector<uint256> script_entries;
+    bool ok = false;
+    try {
+        uint64_t version;
+        int client_version;
+        std::string client_build;
+        file >> version;
+        if (version == SCRIPT_CACHES_DUMP_VERSION) {
+            file >> client_version >> client_build;
+        }
+        // The entries let transactions skip script checks, so only trust
+        // those made by the very same build: another one may verify
+        // differently.
+        if (version != SCRIPT_CACHES_DUMP_VERSION || client_version != CLIENT_VERSION || client_build != CLIENT_BUILD) {
+            LogPrintf("Signature cache file on disk was written by another version. Discarding it.\n");
+        } else {
+            file >> sig_nonce >> sig_entries;
+            file >> script_nonce >> script_entries;
+            ok = true;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+    }
+
+    // The snapshot is only good for the next start after the shutdown that
+    // wrote it. Remove it, so that the node does not pick it up again after
+    // a crash, with caches that moved on since.
+    file.fclose();
+    try {
+        fs::remove(path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Failed to remove signature cache file: %s\n", fsbridge::get_filesystem_error_message(e));
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // The entries are only valid with the nonces they were computed with.
+    LoadSignatureCacheSnapshot(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+
+    LogPrintf("Imported signature cache from disk: %u signature and %u script execution entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    if (!g_script_caches_loaded) {
+        return false;
+    }
+
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce;
+    std::vector<uint256> sig_entries;
+    GetSignatureCacheSnapshot(sig_nonce, sig_entries);
+    uint256 script_nonce;
+    std::vector<uint256> script_entries;
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        script_entries = scriptExecutionCache.elements();
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SCRIPT_CACHES_DUMP_VERSION;
+        file << version;
+        file << CLIENT_VERSION << CLIENT_BUILD;
+        file << sig_nonce << sig_entries;
+        file << script_nonce << script_entries;
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %u signature and %u script execution entries, %gs to copy, %gs to dump\n",
+            sig_entries.size(), script_entries.size(), (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
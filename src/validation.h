@@ -81,6 +81,12 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -prefetchthreads default (number of threads reading block inputs from the chainstate database) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/** Maximum number of input prefetching threads allowed */
+static const int MAX_COINS_PREFETCH_THREADS = 32;
+/** Default for -preverifyscripts */
+static const bool DEFAULT_PREVERIFY_SCRIPTS = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -116,11 +122,16 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
+/** Default for -blockmmapfiles, the number of block files kept memory mapped for reading (0 = read through stdio) */
+static const unsigned int DEFAULT_BLOCK_MMAP_FILES = 0;
 
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
@@ -150,6 +161,7 @@ extern uint256 g_best_block;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern int nCoinsPrefetchThreads;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -244,6 +256,21 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/**
+ * Start verifying the scripts of blocks that are stored ahead of the chain tip
+ * on a background thread, using the script checking threads, so that their
+ * transactions are in the script execution cache by the time they are connected.
+ */
+void StartScriptPreverification();
+/** Stop the script preverification thread and drop the blocks waiting for it */
+void StopScriptPreverification();
+/**
+ * Verify the scripts of the transactions of a block whose spent outputs are in
+ * the coins tip cache or created by recently preverified blocks, and add those
+ * that pass to the script execution cache. Returns the number of transactions
+ * added. This is what the preverification thread runs for each block.
+ */
+size_t PreverifyBlockScripts(const CBlock& block, const CBlockIndex* pindex) LOCKS_EXCLUDED(cs_main);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -361,6 +388,9 @@ public:
 void InitScriptExecutionCache();
 
 
+/** Keep up to max_files block files memory mapped to serve block reads from; 0 disables mapping */
+void InitBlockFileMapCache(size_t max_files);
+
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
@@ -483,6 +513,7 @@ public:
     void Unload() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -495,6 +526,18 @@ public:
         CValidationState& state,
         const CChainParams& chainparams,
         CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /**
+     * As above, for a header whose hash is already known. fCheckPOW=false skips
+     * the proof of work check, for callers that did it before taking cs_main.
+     */
+    bool AcceptBlockHeader(
+        const CBlockHeader& block,
+        const uint256& hash,
+        bool fCheckPOW,
+        CValidationState& state,
+        const CChainParams& chainparams,
+        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -511,7 +554,16 @@ class CoinsViews {
 public:
     //! The lowest level of the CoinsViews cache hierarchy sits in a leveldb database on disk.
     //! All unspent coins reside in this store.
-    CCoinsViewDB m_dbview GUARDED_BY(cs_main);
+    //!
+    //! Not guarded by cs_main: the flush thread of m_asyncview writes to it without cs_main.
+    //! Every other user holds cs_main, which keeps a new flush from starting, and calls
+    //! m_asyncview.WaitForFlush(), which joins the flush thread, before relying on its
+    //! contents. Reads through m_asyncview are safe at any time (see CCoinsViewAsyncFlush).
+    CCoinsViewDB m_dbview;
+
+    //! This view commits flushed coins to m_dbview on a background thread, serving them
+    //! from memory until then.
+    CCoinsViewAsyncFlush m_asyncview GUARDED_BY(cs_main);
 
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
@@ -633,6 +685,13 @@ public:
         return m_coins_views->m_dbview;
     }
 
+    //! @returns A reference to the view committing flushed coins to CoinsDB()
+    //!     in the background.
+    CCoinsViewAsyncFlush& CoinsAsyncFlush() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        return m_coins_views->m_asyncview;
+    }
+
     //! @returns A reference to a wrapped view of the in-memory UTXO set that
     //!     handles disk read errors gracefully.
     CCoinsViewErrorCatcher& CoinsErrorCatcher() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -798,6 +857,12 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature and script execution caches to disk, with their nonces and the client version. Only done once they were loaded. */
+bool DumpScriptCaches();
+
+/** Load the signature and script execution caches from disk, unless written by another client version, and remove the file. Must happen before the caches are used. */
+bool LoadScriptCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Global developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test signature cache persistence.
+
+By default, bitglobd dumps the signature and script execution caches to
+sigcache.dat on shutdown and loads them again on startup. Check that:
+
+  - after a restart, revalidating the persisted mempool only hits the cache;
+  - the file is removed once loaded;
+  - a file written by another client version is discarded;
+  - a corrupt file is discarded and does not keep the node from starting.
+"""
+
+import os
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+# Regtest key the coinbase outputs are paid to
+PRIV_KEY = 'cMceqPhHedrhbcR9eXgzmfWy7kRqLyAxMYwFT6ABDWsiwUp9Nsq9'
+
+
+class PersistSigCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def restart(self, expected_msgs, tamper=None):
+        """Restart the node, optionally changing sigcache.dat in between, and
+        return the signature cache stats once the mempool is loaded again."""
+        node = self.nodes[0]
+        self.stop_node(0)
+        assert os.path.exists(self.sigcache_path)
+        if tamper:
+            with open(self.sigcache_path, 'r+b') as f:
+                tamper(f)
+        with node.assert_debug_log(expected_msgs):
+            self.start_node(0)
+        wait_until(lambda: node.getmempoolinfo()['size'] == 1)
+        # The snapshot is only used once.
+        assert not os.path.exists(self.sigcache_path)
+        return node.getsigcacheinfo()
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.sigcache_path = os.path.join(node.datadir, 'regtest', 'sigcache.dat')
+
+        self.log.info("Put a signed transaction into the mempool")
+        address = node.deriveaddresses(node.getdescriptorinfo('pkh({})'.format(PRIV_KEY))['descriptor'])[0]
+        coinbase_block = node.generatetoaddress(1, address)[0]
+        node.generatetoaddress(100, ADDRESS_BCRT1_UNSPENDABLE)
+        coinbase_txid = node.getblock(coinbase_block)['tx'][0]
+        raw_tx = node.createrawtransaction([{'txid': coinbase_txid, 'vout': 0}], {ADDRESS_BCRT1_UNSPENDABLE: 49.99})
+        signed_tx = node.signrawtransactionwithkey(raw_tx, [PRIV_KEY])
+        assert signed_tx['complete']
+        node.sendrawtransaction(signed_tx['hex'])
+        assert node.getsigcacheinfo()['misses'] > 0
+
+        self.log.info("Check that the caches are dumped on shutdown and loaded on restart")
+        stats = self.restart(["Imported signature cache from disk"])
+        assert stats['hits'] > 0
+        assert_equal(stats['misses'], 0)
+
+        self.log.info("Check that a file written by another version is discarded")
+        def bump_client_version(f):
+            # The client version follows the 8 byte file format version.
+            f.seek(8)
+            client_version = int.from_bytes(f.read(4), 'little')
+            f.seek(8)
+            f.write((client_version + 1).to_bytes(4, 'little'))
+        stats = self.restart(["Signature cache file on disk was written by another version. Discarding it."], bump_client_version)
+        assert stats['misses'] > 0
+
+        self.log.info("Check that a corrupt file is discarded")
+        stats = self.restart(["Failed to deserialize signature cache data on disk"], lambda f: f.truncate(os.path.getsize(self.sigcache_path) // 2))
+        assert stats['misses'] > 0
+
+        self.log.info("Check that the caches are dumped again after that")
+        stats = self.restart(["Imported signature cache from disk"])
+        assert stats['hits'] > 0
+        assert_equal(stats['misses'], 0)
+
+
+if __name__ == '__main__':
+    PersistSigCacheTest().main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Global developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test serving the stored bytes of blocks through REST and getblock.
+
+With witness serialization, /rest/block in binary and hex format and getblock
+with verbosity 0 return the block as stored on disk. Check that this matches
+the block serialized again, that -rpcserialversion=0 still strips witnesses,
+and that a missing block file is reported as such. Pruned blocks are covered
+by the rpc_getblock_raw unit test.
+"""
+
+import http.client
+import os
+import urllib.parse
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.messages import CBlock, FromHex
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+
+class RESTRawBlockTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-rest"], ["-rest", "-rpcserialversion=0"]]
+
+    def rest_block(self, node, blockhash, ext, status=200):
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/block/{}.{}'.format(blockhash, ext))
+        resp = conn.getresponse()
+        assert_equal(resp.status, status)
+        return resp.read()
+
+    def run_test(self):
+        node = self.nodes[0]
+        blockhash = node.generatetoaddress(10, ADDRESS_BCRT1_UNSPENDABLE)[-1]
+        self.sync_all()
+
+        self.log.info("Check that the stored bytes match the block serialized again")
+        raw = node.getblock(blockhash, 0)
+        block = FromHex(CBlock(), raw)
+        block.rehash()
+        assert_equal(block.hash, blockhash)
+        assert_equal(block.serialize().hex(), raw)
+        stripped = block.serialize(with_witness=False).hex()
+        # The coinbase witness makes sure the witness path was taken.
+        assert raw != stripped
+        assert_equal(self.rest_block(node, blockhash, 'bin'), bytes.fromhex(raw))
+        assert_equal(self.rest_block(node, blockhash, 'hex'), (raw + '\n').encode())
+
+        self.log.info("Check that -rpcserialversion=0 strips the witnesses")
+        assert_equal(self.nodes[1].getblock(blockhash, 0), stripped)
+        assert_equal(self.rest_block(self.nodes[1], blockhash, 'bin'), bytes.fromhex(stripped))
+        assert_equal(self.rest_block(self.nodes[1], blockhash, 'hex'), (stripped + '\n').encode())
+
+        self.log.info("Check a missing block file")
+        blk_path = os.path.join(node.datadir, 'regtest', 'blocks', 'blk00000.dat')
+        os.rename(blk_path, blk_path + '.moved')
+        assert_raises_rpc_error(-1, "Block not found on disk", node.getblock, blockhash, 0)
+        assert_equal(self.rest_block(node, blockhash, 'bin', status=404), (blockhash + ' not found\r\n').encode())
+        os.rename(blk_path + '.moved', blk_path)
+        assert_equal(node.getblock(blockhash, 0), raw)
+
+
+if __name__ == '__main__':
+    RESTRawBlockTest().main()
@@ -241,6 +241,21 @@ class BlockchainTest(BitcoinTestFramework):
         del res['disk_size'], res3['disk_size']
         assert_equal(res, res3)
 
+        self.log.info("Test hash_type option for gettxoutsetinfo()")
+        res4 = node.gettxoutsetinfo(hash_type='muhash')
+        assert_equal(len(res4['muhash']), 64)
+        assert 'hash_serialized_2' not in res4
+        res5 = node.gettxoutsetinfo(hash_type='none')
+        assert 'hash_serialized_2' not in res5
+        assert 'muhash' not in res5
+        for r in (res4, res5):
+            del r['disk_size']
+            assert_equal(r['total_amount'], res['total_amount'])
+            assert_equal(r['txouts'], res['txouts'])
+            assert_equal(r['transactions'], res['transactions'])
+            assert_equal(r['bogosize'], res['bogosize'])
+        assert_raises_rpc_error(-8, "foohash is not a valid hash_type", node.gettxoutsetinfo, "foohash")
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 
@@ -122,10 +122,12 @@ BASE_SCRIPTS = [
     'rpc_getchaintips.py',
     'rpc_misc.py',
     'interface_rest.py',
+    'interface_rest_rawblock.py',
     'mempool_spend_coinbase.py',
     'wallet_avoidreuse.py',
     'mempool_reorg.py',
     'mempool_persist.py',
+    'feature_persist_sigcache.py',
     'wallet_multiwallet.py',
     'wallet_multiwallet.py --usecli',
     'wallet_createwallet.py',